@@ -0,0 +1,36 @@
+#ifndef __LOG_RING_H__
+#define __LOG_RING_H__
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_http_server.h"
+
+#define LOG_RING_TEXT_LEN       (32)
+
+/* Arguments are stored as 32 bit words, so formats may only use integer
+ * conversions and %s on strings with static lifetime. A string that does not
+ * outlive the call goes through the _STR variants, it is copied into the record
+ * (truncated to LOG_RING_TEXT_LEN) and must be the first conversion of fmt. */
+#if CONFIG_LOG_RING_ENABLE
+#define LOG_RING_PAD(_z, a, b, c, ...)  (uint32_t)(a), (uint32_t)(b), (uint32_t)(c)
+#define LOG_RING(level, tag, fmt, ...) \
+            log_ring_write(level, tag, fmt, NULL, LOG_RING_PAD(0, ##__VA_ARGS__, 0, 0, 0))
+#define LOG_RING_STR(level, tag, fmt, text, ...) \
+            log_ring_write(level, tag, fmt, text, LOG_RING_PAD(0, ##__VA_ARGS__, 0, 0, 0))
+#else
+#define LOG_RING(level, tag, fmt, ...)              ESP_LOG_LEVEL(level, tag, fmt, ##__VA_ARGS__)
+#define LOG_RING_STR(level, tag, fmt, text, ...)    ESP_LOG_LEVEL(level, tag, fmt, text, ##__VA_ARGS__)
+#endif
+
+#define LOG_RING_E(tag, fmt, ...)           LOG_RING(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define LOG_RING_I(tag, fmt, ...)           LOG_RING(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define LOG_RING_STR_E(tag, fmt, text, ...) LOG_RING_STR(ESP_LOG_ERROR, tag, fmt, text, ##__VA_ARGS__)
+#define LOG_RING_STR_I(tag, fmt, text, ...) LOG_RING_STR(ESP_LOG_INFO, tag, fmt, text, ##__VA_ARGS__)
+
+//Functions
+esp_err_t log_ring_init (void);
+void log_ring_write (esp_log_level_t level, const char * tag, const char * fmt, const char * text,
+                        uint32_t a0, uint32_t a1, uint32_t a2);
+uint32_t log_ring_drops (void);
+esp_err_t log_ring_get_handler (httpd_req_t * req);
+#endif
@@ -0,0 +1,216 @@
+#include "string.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "sys/param.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "cJSON.h"
+#include "log_ring.h"
+#include "trace.h"
+
+#define LOG_TAG             "[log_ring]"
+#define LOG_RING_DRAIN_MS   (20)
+#define LOG_RING_LINE_LEN   (160)
+
+#if CONFIG_LOG_RING_ENABLE
+#define LOG_RING_MASK       (CONFIG_LOG_RING_SIZE - 1)
+_Static_assert((CONFIG_LOG_RING_SIZE & LOG_RING_MASK) == 0, "LOG_RING_SIZE must be a power of two");
+
+typedef struct
+{
+    // head + 1 of the reservation once the record is complete
+    uint32_t seq;
+    uint8_t level;
+    uint8_t core;
+    // text was given, fmt takes it as its first conversion
+    bool has_text;
+    uint32_t time_ms;
+    const char * tag;
+    const char * fmt;
+    uint32_t args[3];
+    char text[LOG_RING_TEXT_LEN];
+} log_record_t;
+
+typedef struct
+{
+    uint32_t head;
+    uint32_t tail;
+    log_record_t record[CONFIG_LOG_RING_SIZE];
+} log_ring_t;
+
+typedef struct
+{
+    log_ring_t ring[portNUM_PROCESSORS];
+    uint32_t drops;
+    SemaphoreHandle_t history_lock;
+    uint32_t history_count;
+    log_record_t history[CONFIG_LOG_RING_HISTORY];
+} log_ring_obj_t;
+
+// Functions declaration
+void log_ring_drain_task (void * pvParameter);
+static void log_ring_format (const log_record_t * record, char * line, size_t line_len);
+
+//Variables declaration
+static log_ring_obj_t s_log;
+
+esp_err_t log_ring_init (void)
+{
+    s_log.history_lock = xSemaphoreCreateMutex();
+
+    if ((NULL == s_log.history_lock) || 
+            (pdPASS != xTaskCreate(&log_ring_drain_task, "log_ring", 3072, NULL, tskIDLE_PRIORITY + 1, NULL)))
+    {
+        ESP_LOGE(LOG_TAG, "Failed to start log drain task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+/* Hot path: reserve a slot in the ring of the current core and copy the arguments.
+ * Several tasks may write to the same ring, the slot is claimed with a CAS. */
+void log_ring_write (esp_log_level_t level, const char * tag, const char * fmt, const char * text,
+                        uint32_t a0, uint32_t a1, uint32_t a2)
+{
+    log_ring_t * ring = &s_log.ring[xPortGetCoreID()];
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+    do
+    {
+        if ((head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) >= CONFIG_LOG_RING_SIZE)
+        {
+            __atomic_fetch_add(&s_log.drops, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&ring->head, &head, head + 1, true, 
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    log_record_t * record = &ring->record[head & LOG_RING_MASK];
+    record->level = level;
+    record->core = xPortGetCoreID();
+    record->time_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    record->tag = tag;
+    record->fmt = fmt;
+    record->args[0] = a0;
+    record->args[1] = a1;
+    record->args[2] = a2;
+
+    record->has_text = (NULL != text);
+
+    if (NULL != text)
+    {
+        strlcpy(record->text, text, sizeof(record->text));
+    }
+    else
+    {
+        record->text[0] = '\0';
+    }
+    __atomic_store_n(&record->seq, head + 1, __ATOMIC_RELEASE);
+}
+
+static void log_ring_format (const log_record_t * record, char * line, size_t line_len)
+{
+    if (true == record->has_text)
+    {
+        snprintf(line, line_len, record->fmt, record->text, 
+                    record->args[0], record->args[1], record->args[2]);
+    }
+    else
+    {
+        snprintf(line, line_len, record->fmt, record->args[0], record->args[1], record->args[2]);
+    }
+}
+
+/* Formats and prints completed records, off the request path */
+void log_ring_drain_task (void * pvParameter)
+{
+    static const char level_char[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+    char line[LOG_RING_LINE_LEN];
+    log_record_t record;
+
+    while (1)
+    {
+        for (int core = 0; core < portNUM_PROCESSORS; core++)
+        {
+            log_ring_t * ring = &s_log.ring[core];
+            uint32_t tail = ring->tail;
+            log_record_t * slot = &ring->record[tail & LOG_RING_MASK];
+
+            while (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == tail + 1)
+            {
+                record = *slot;
+                __atomic_store_n(&ring->tail, ++tail, __ATOMIC_RELEASE);
+                slot = &ring->record[tail & LOG_RING_MASK];
+
+                log_ring_format(&record, line, sizeof(line));
+                esp_log_write(record.level, record.tag, "%c (%lu) %s: %s\n", 
+                                level_char[record.level], record.time_ms, record.tag, line);
+
+                xSemaphoreTake(s_log.history_lock, portMAX_DELAY);
+                s_log.history[s_log.history_count % CONFIG_LOG_RING_HISTORY] = record;
+                s_log.history_count++;
+                xSemaphoreGive(s_log.history_lock);
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(LOG_RING_DRAIN_MS));
+    }
+}
+#else
+/* Nothing to start, the LOG_RING macros print directly */
+esp_err_t log_ring_init (void)
+{
+    return ESP_OK;
+}
+#endif
+
+uint32_t log_ring_drops (void)
+{
+    #if CONFIG_LOG_RING_ENABLE
+    return __atomic_load_n(&s_log.drops, __ATOMIC_RELAXED);
+    #else
+    return 0;
+    #endif
+}
+
+/* Most recent records, oldest first */
+esp_err_t log_ring_get_handler (httpd_req_t * req)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "drops", log_ring_drops());
+    cJSON *records = cJSON_AddArrayToObject(root, "records");
+
+    #if CONFIG_LOG_RING_ENABLE
+    char line[LOG_RING_LINE_LEN];
+    log_record_t record;
+
+    xSemaphoreTake(s_log.history_lock, portMAX_DELAY);
+    uint32_t count = MIN(s_log.history_count, CONFIG_LOG_RING_HISTORY);
+
+    for (uint32_t i = s_log.history_count - count; i < s_log.history_count; i++)
+    {
+        record = s_log.history[i % CONFIG_LOG_RING_HISTORY];
+        log_ring_format(&record, line, sizeof(line));
+
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "time_ms", record.time_ms);
+        cJSON_AddNumberToObject(item, "core", record.core);
+        cJSON_AddNumberToObject(item, "level", record.level);
+        cJSON_AddStringToObject(item, "tag", record.tag);
+        cJSON_AddStringToObject(item, "msg", line);
+        cJSON_AddItemToArray(records, item);
+    }
+    xSemaphoreGive(s_log.history_lock);
+    #endif
+
+    TRACE_SPAN_BEGIN(span);
+    const char * json = cJSON_Print(root);
+    TRACE_SPAN_END(span, "cjson_print", (NULL != json) ? strlen(json) : 0);
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err_ret = httpd_resp_sendstr(req, json);
+    free((void *)json);
+    cJSON_Delete(root);
+    return err_ret;
+}
@@ -5,6 +5,13 @@
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
 #include "esp_eth.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+
+/* Network state published to other tasks, see network_wait() */
+#define NETWORK_LINK_UP_BIT         BIT0
+#define NETWORK_CONNECTED_BIT       BIT1
+#define NETWORK_DISCONNECTED_BIT    BIT2
 
 typedef struct
 {
@@ -12,6 +19,29 @@ typedef struct
     char mdns_instance_name[64];
 }mdns_obj_t;
 
+typedef enum
+{
+    NETWORK_STATE_DOWN = 0,
+    NETWORK_STATE_LINK_UP,
+    NETWORK_STATE_CONNECTED
+} network_state_t;
+
+/* Link supervision, drivers stay installed across link flaps and the
+ * time from link loss to a new IP is recorded */
+typedef struct
+{
+    network_state_t state;
+    uint32_t link_flaps;
+    uint32_t retries;
+    int64_t down_us;
+    int64_t last_recover_us;
+    int64_t max_recover_us;
+    int64_t start_us;
+    int64_t bringup_us;
+    int8_t bringup_idle_pct;
+    esp_timer_handle_t reconnect_timer;
+} network_supervisor_t;
+
 typedef struct
 {
     EventGroupHandle_t wifi_event_group;
@@ -21,22 +51,24 @@ typedef struct
     char ssid[32];
     char password[64];
     mdns_obj_t mdns_cred;
+    network_supervisor_t supervisor;
 } wifi_obj_t;
 
 typedef struct
 {
-    EventGroupHandle_t ethernet_event_group;
-    uint8_t CONNECTED_BIT;
-    uint8_t FAILED_BIT;
-    bool ethernet_status_flag;
     esp_eth_handle_t s_eth_handle;
     esp_eth_mac_t * s_eth_mac;
     esp_eth_phy_t * s_eth_phy;
     esp_eth_netif_glue_handle_t s_eth_glue;
+    esp_netif_t * s_eth_netif;
     mdns_obj_t mdns_cred;
+    network_supervisor_t supervisor;
 }ethernet_obj_t;
 
 void wifi_init (wifi_obj_t *);
 void ethernet_init (ethernet_obj_t *);
 void ethernet_shutdown (ethernet_obj_t *);
+void network_get_supervisor (network_supervisor_t *);
+EventBits_t network_wait (EventBits_t, TickType_t);
+const char * network_profile_name (void);
 #endif
\ No newline at end of file
@@ -11,12 +11,40 @@
 #include "lwip/sys.h"
 #include "esp_log.h"
 #include "esp_mac.h"
+#include "esp_random.h"
 #include "string.h"
+#include "stdlib.h"
+#include "sys/param.h"
 #include "mdns.h"
 #include "lwip/apps/netbiosns.h"
 #include "network.h"
+#include "trace.h"
 
 #define LOG_TAG		"[network]"
+
+/* Runtime half of the performance profile, the lwIP half comes from sdkconfig.profile.* */
+#if CONFIG_NETWORK_PROFILE_LOW_MEMORY
+#define NETWORK_PROFILE_NAME        "low-memory"
+#define PROFILE_ETH_RX_STACK        (2048)
+#define PROFILE_WIFI_STATIC_RX      (4)
+#define PROFILE_WIFI_DYNAMIC_RX     (16)
+#define PROFILE_WIFI_DYNAMIC_TX     (16)
+#define PROFILE_WIFI_BA_WIN         (6)
+#define PROFILE_TCP_WND_MIN         (2 * 1440)
+#elif CONFIG_NETWORK_PROFILE_THROUGHPUT
+#define NETWORK_PROFILE_NAME        "throughput"
+#define PROFILE_ETH_RX_STACK        (4096)
+#define PROFILE_WIFI_STATIC_RX      (16)
+#define PROFILE_WIFI_DYNAMIC_RX     (64)
+#define PROFILE_WIFI_DYNAMIC_TX     (64)
+#define PROFILE_WIFI_BA_WIN         (32)
+#define PROFILE_TCP_WND_MIN         (16 * 1440)
+#else
+#define NETWORK_PROFILE_NAME        "balanced"
+#define PROFILE_ETH_RX_STACK        (4096)
+#define PROFILE_TCP_WND_MIN         (4 * 1440)
+#endif
+
 #if CONFIG_LWIP_IPV6
 /* types of ipv6 addresses to be displayed on ipv6 events */
 const char * ipv6_addr_types_to_str[6] = 
@@ -38,8 +66,30 @@ void wifi_event_handler (void * arg, esp_event_base_t event_base, int32_t event_
                                 void * event_data);
 void ethernet_event_handler (void * arg, esp_event_base_t event_base,int32_t event_id, 
                                 void * event_data);
+void network_supervisor_init (network_supervisor_t * supervisor, esp_timer_cb_t reconnect_cb, 
+                                void * arg);
+void network_supervisor_link_down (network_supervisor_t * supervisor);
+void network_supervisor_link_up (network_supervisor_t * supervisor);
+void network_supervisor_connected (network_supervisor_t * supervisor);
+void network_publish (EventBits_t set_bits, EventBits_t clear_bits);
+#if CONFIG_NETWORK_BRINGUP_CPU_STATS
+void network_cpu_sample (configRUN_TIME_COUNTER_TYPE * idle, configRUN_TIME_COUNTER_TYPE * total);
+#endif
+void wifi_schedule_reconnect (wifi_obj_t * wifi_obj);
+void wifi_reconnect_cb (void * arg);
+#if CONFIG_NETWORK_LINK_FLAP_INJECT
+void link_flap_task (void * pvParameter);
+#endif
 
 //Variables declaration
+static network_supervisor_t * s_supervisor = NULL;
+/* The event task updates the supervisor while the httpd task copies it */
+static portMUX_TYPE s_supervisor_lock = portMUX_INITIALIZER_UNLOCKED;
+static EventGroupHandle_t s_network_events = NULL;
+#if CONFIG_NETWORK_BRINGUP_CPU_STATS
+static configRUN_TIME_COUNTER_TYPE s_idle_start[portNUM_PROCESSORS];
+static configRUN_TIME_COUNTER_TYPE s_total_start;
+#endif
 
 void network_app_init (void)
 {
@@ -52,6 +102,19 @@ void network_app_init (void)
         err_ret = nvs_flash_init();
     }
 
+    /* A profile picked in menuconfig alone keeps the lwIP sizes of the previous build */
+    if (CONFIG_LWIP_TCP_WND_DEFAULT < PROFILE_TCP_WND_MIN)
+    {
+        ESP_LOGW(LOG_TAG, "TCP window %d is below the %s profile (%d), build with its sdkconfig.profile.* file", 
+                    CONFIG_LWIP_TCP_WND_DEFAULT, NETWORK_PROFILE_NAME, PROFILE_TCP_WND_MIN);
+    }
+
+    if (NULL == s_network_events)
+    {
+        s_network_events = xEventGroupCreate();
+        xEventGroupSetBits(s_network_events, NETWORK_DISCONNECTED_BIT);
+    }
+
     if(ESP_OK == err_ret)
     {
         // Initialize the TCP/IP stack
@@ -65,6 +128,198 @@ void network_app_init (void)
     }
 }
 
+void network_supervisor_init (network_supervisor_t * supervisor, esp_timer_cb_t reconnect_cb, 
+                                void * arg)
+{
+    esp_timer_handle_t reconnect_timer = NULL;
+
+    if (NULL != reconnect_cb)
+    {
+        const esp_timer_create_args_t timer_args = 
+        {
+            .callback = reconnect_cb,
+            .arg = arg,
+            .name = "net_reconnect"
+        };
+        esp_timer_create(&timer_args, &reconnect_timer);
+    }
+#if CONFIG_NETWORK_BRINGUP_CPU_STATS
+    network_cpu_sample(s_idle_start, &s_total_start);
+#endif
+
+    taskENTER_CRITICAL(&s_supervisor_lock);
+    memset(supervisor, 0, sizeof(network_supervisor_t));
+    supervisor->state = NETWORK_STATE_DOWN;
+    supervisor->start_us = esp_timer_get_time();
+    supervisor->bringup_idle_pct = -1;
+    supervisor->reconnect_timer = reconnect_timer;
+    s_supervisor = supervisor;
+    taskEXIT_CRITICAL(&s_supervisor_lock);
+}
+
+/* Link or association lost, the drivers stay installed and the time to recover starts */
+void network_supervisor_link_down (network_supervisor_t * supervisor)
+{
+    bool was_up;
+    uint32_t link_flaps;
+
+    taskENTER_CRITICAL(&s_supervisor_lock);
+    was_up = (NETWORK_STATE_DOWN != supervisor->state);
+
+    if (true == was_up)
+    {
+        supervisor->link_flaps++;
+        supervisor->down_us = esp_timer_get_time();
+    }
+    supervisor->state = NETWORK_STATE_DOWN;
+    link_flaps = supervisor->link_flaps;
+    taskEXIT_CRITICAL(&s_supervisor_lock);
+
+    if (true == was_up)
+    {
+        TRACE_INSTANT("link_down", link_flaps);
+        ESP_LOGI(LOG_TAG, "Link down (flap %lu)", link_flaps);
+    }
+    network_publish(NETWORK_DISCONNECTED_BIT, NETWORK_LINK_UP_BIT | NETWORK_CONNECTED_BIT);
+}
+
+void network_supervisor_link_up (network_supervisor_t * supervisor)
+{
+    taskENTER_CRITICAL(&s_supervisor_lock);
+    supervisor->state = NETWORK_STATE_LINK_UP;
+    taskEXIT_CRITICAL(&s_supervisor_lock);
+    TRACE_INSTANT("link_up", 0);
+    network_publish(NETWORK_LINK_UP_BIT, 0);
+}
+
+void network_supervisor_connected (network_supervisor_t * supervisor)
+{
+    int64_t now_us = esp_timer_get_time();
+    int64_t recover_us = 0;
+    int64_t bringup_us = 0;
+    uint32_t retries;
+
+    taskENTER_CRITICAL(&s_supervisor_lock);
+    retries = supervisor->retries;
+
+    if (0 != supervisor->down_us)
+    {
+        recover_us = now_us - supervisor->down_us;
+        supervisor->last_recover_us = recover_us;
+        supervisor->max_recover_us = MAX(supervisor->max_recover_us, recover_us);
+        supervisor->down_us = 0;
+    }
+    else if (0 == supervisor->bringup_us)
+    {
+        bringup_us = now_us - supervisor->start_us;
+        supervisor->bringup_us = bringup_us;
+    }
+    supervisor->retries = 0;
+    supervisor->state = NETWORK_STATE_CONNECTED;
+    taskEXIT_CRITICAL(&s_supervisor_lock);
+
+    if (0 != recover_us)
+    {
+        ESP_LOGI(LOG_TAG, "Recovered in %lld ms after %lu retries", recover_us / 1000, retries);
+    }
+    else if (0 != bringup_us)
+    {
+    #if CONFIG_NETWORK_BRINGUP_CPU_STATS
+        /* Report the busiest core, waiting for the IP should leave it idle */
+        configRUN_TIME_COUNTER_TYPE idle[portNUM_PROCESSORS];
+        configRUN_TIME_COUNTER_TYPE total;
+        int8_t idle_pct = 100;
+        network_cpu_sample(idle, &total);
+
+        for (int core = 0; (core < portNUM_PROCESSORS) && (total != s_total_start); core++)
+        {
+            idle_pct = MIN(idle_pct, 
+                        (int8_t)(100ULL * (idle[core] - s_idle_start[core]) / (total - s_total_start)));
+        }
+        taskENTER_CRITICAL(&s_supervisor_lock);
+        supervisor->bringup_idle_pct = idle_pct;
+        taskEXIT_CRITICAL(&s_supervisor_lock);
+        ESP_LOGI(LOG_TAG, "Connected %lld ms after start, least idle core %d%%", 
+                    bringup_us / 1000, idle_pct);
+    #else
+        ESP_LOGI(LOG_TAG, "Connected %lld ms after start", bringup_us / 1000);
+    #endif
+    }
+    TRACE_INSTANT("got_ip", retries);
+    network_publish(NETWORK_LINK_UP_BIT | NETWORK_CONNECTED_BIT, NETWORK_DISCONNECTED_BIT);
+}
+
+void network_publish (EventBits_t set_bits, EventBits_t clear_bits)
+{
+    if (NULL != s_network_events)
+    {
+        xEventGroupClearBits(s_network_events, clear_bits);
+        xEventGroupSetBits(s_network_events, set_bits);
+    }
+}
+
+/* Block until any of bits is set, consumers wait here instead of polling the state.
+ * CONNECTED and DISCONNECTED are never set together, so a change can be awaited either way. */
+EventBits_t network_wait (EventBits_t bits, TickType_t ticks_to_wait)
+{
+    if (NULL == s_network_events)
+    {
+        vTaskDelay(ticks_to_wait);
+        return 0;
+    }
+
+    return xEventGroupWaitBits(s_network_events, bits, pdFALSE, pdFALSE, ticks_to_wait) & bits;
+}
+
+#if CONFIG_NETWORK_BRINGUP_CPU_STATS
+/* Run time of the idle task of each core and the total run time */
+void network_cpu_sample (configRUN_TIME_COUNTER_TYPE * idle, configRUN_TIME_COUNTER_TYPE * total)
+{
+    UBaseType_t count = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t * tasks = malloc(count * sizeof(TaskStatus_t));
+
+    memset(idle, 0, portNUM_PROCESSORS * sizeof(configRUN_TIME_COUNTER_TYPE));
+    *total = 0;
+
+    if (NULL != tasks)
+    {
+        count = uxTaskGetSystemState(tasks, count, total);
+
+        for (UBaseType_t i = 0; i < count; i++)
+        {
+            for (int core = 0; core < portNUM_PROCESSORS; core++)
+            {
+                if (tasks[i].xHandle == xTaskGetIdleTaskHandleForCore(core))
+                {
+                    idle[core] = tasks[i].ulRunTimeCounter;
+                }
+            }
+        }
+        free(tasks);
+    }
+}
+#endif
+
+void network_get_supervisor (network_supervisor_t * supervisor)
+{
+    taskENTER_CRITICAL(&s_supervisor_lock);
+
+    if (NULL != s_supervisor)
+    {
+        *supervisor = *s_supervisor;
+    }
+    else
+    {
+        memset(supervisor, 0, sizeof(network_supervisor_t));
+    }
+    taskEXIT_CRITICAL(&s_supervisor_lock);
+}
+
+const char * network_profile_name (void)
+{
+    return NETWORK_PROFILE_NAME;
+}
+
 void wifi_init (wifi_obj_t * wifi_obj)
 {
     wifi_config_t wifi_config;
@@ -73,6 +328,7 @@ void wifi_init (wifi_obj_t * wifi_obj)
     wifi_obj->CONNECTED_BIT = BIT0;
     wifi_obj->FAILED_BIT = BIT1;
     wifi_obj->wifi_status_flag = false;
+    network_supervisor_init(&wifi_obj->supervisor, wifi_reconnect_cb, wifi_obj);
 
     network_app_init();
     initialise_mdns(&wifi_obj->mdns_cred);
@@ -84,6 +340,12 @@ void wifi_init (wifi_obj_t * wifi_obj)
     wifi_obj->wifi_event_group = xEventGroupCreate();
     // Initialize the Wi-Fi driver
     wifi_init_config_t wifi_init_config = WIFI_INIT_CONFIG_DEFAULT();
+    #ifdef PROFILE_WIFI_STATIC_RX
+    wifi_init_config.static_rx_buf_num = PROFILE_WIFI_STATIC_RX;
+    wifi_init_config.dynamic_rx_buf_num = PROFILE_WIFI_DYNAMIC_RX;
+    wifi_init_config.dynamic_tx_buf_num = PROFILE_WIFI_DYNAMIC_TX;
+    wifi_init_config.rx_ba_win = PROFILE_WIFI_BA_WIN;
+    #endif
     esp_err_t err_ret  = esp_wifi_init(&wifi_init_config);
 
     if (ESP_OK == err_ret)
@@ -162,17 +424,47 @@ void wifi_event_handler (void * arg, esp_event_base_t event_base,
     {
         esp_wifi_connect();
     }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) 
+    {
+        network_supervisor_link_up(&wifi_obj->supervisor);
+    }
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) 
     {
         xEventGroupClearBits(wifi_obj->wifi_event_group, wifi_obj->CONNECTED_BIT);
-        esp_wifi_connect();
+        network_supervisor_link_down(&wifi_obj->supervisor);
+        wifi_schedule_reconnect(wifi_obj);
     } 
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) 
     {
+        network_supervisor_connected(&wifi_obj->supervisor);
         xEventGroupSetBits(wifi_obj->wifi_event_group, wifi_obj->CONNECTED_BIT);
     }
 }
 
+/* Exponential backoff with jitter so a lost AP is not hammered by every station at once */
+void wifi_schedule_reconnect (wifi_obj_t * wifi_obj)
+{
+    network_supervisor_t * supervisor = &wifi_obj->supervisor;
+
+    if ((NULL == supervisor->reconnect_timer) || esp_timer_is_active(supervisor->reconnect_timer))
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL(&s_supervisor_lock);
+    uint32_t retries = supervisor->retries++;
+    taskEXIT_CRITICAL(&s_supervisor_lock);
+    uint32_t delay_ms = MIN((uint32_t)CONFIG_NETWORK_RECONNECT_BASE_MS << MIN(retries, 16), 
+                                (uint32_t)CONFIG_NETWORK_RECONNECT_MAX_MS);
+    delay_ms += esp_random() % (delay_ms / 2 + 1);
+    esp_timer_start_once(supervisor->reconnect_timer, (uint64_t)delay_ms * 1000);
+}
+
+void wifi_reconnect_cb (void * arg)
+{
+    esp_wifi_connect();
+}
+
 void ethernet_init (ethernet_obj_t * eth_obj)
 {
     network_app_init();
@@ -181,11 +473,7 @@ void ethernet_init (ethernet_obj_t * eth_obj)
     netbiosns_set_name(eth_obj->mdns_cred.mdns_host_name);
 
     // Initialize ethernet object
-    eth_obj->CONNECTED_BIT = BIT0;
-    eth_obj->FAILED_BIT = BIT1;
-    eth_obj->ethernet_status_flag = false;
-    // Create the event group to handle Ethernet events
-    eth_obj->ethernet_event_group = xEventGroupCreate();
+    network_supervisor_init(&eth_obj->supervisor, NULL, NULL);
     esp_netif_inherent_config_t esp_netif_config = ESP_NETIF_INHERENT_DEFAULT_ETH();
     // Warning: the interface desc is used in tests to capture actual connection
     //  details (IP, gw, mask)
@@ -198,9 +486,10 @@ void ethernet_init (ethernet_obj_t * eth_obj)
     };
     esp_netif_t * p_netif = esp_netif_new(&netif_config);
     assert(p_netif);
+    eth_obj->s_eth_netif = p_netif;
 
     eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
-    mac_config.rx_task_stack_size = 2048;
+    mac_config.rx_task_stack_size = PROFILE_ETH_RX_STACK;
     eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
     phy_config.phy_addr = -1;
     phy_config.reset_gpio_num = -1;
@@ -222,14 +511,17 @@ void ethernet_init (ethernet_obj_t * eth_obj)
         esp_netif_attach(p_netif, eth_obj->s_eth_glue);
         // Register user defined event handers
         esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, &ethernet_event_handler, eth_obj);
-    #ifdef CONFIG_LWIP_IPV6
         esp_event_handler_register(ETH_EVENT, ETHERNET_EVENT_CONNECTED, 
-                                        &ethernet_event_handler, p_netif);
+                                        &ethernet_event_handler, eth_obj);
+        esp_event_handler_register(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, 
+                                        &ethernet_event_handler, eth_obj);
+    #ifdef CONFIG_LWIP_IPV6
         esp_event_handler_register(IP_EVENT, IP_EVENT_GOT_IP6, &ethernet_event_handler, eth_obj);
     #endif
         esp_eth_start(eth_obj->s_eth_handle);
-        xEventGroupWaitBits(eth_obj->ethernet_event_group, 
-                                    eth_obj->CONNECTED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+    #if CONFIG_NETWORK_LINK_FLAP_INJECT
+        xTaskCreate(&link_flap_task, "link_flap_task", 2048, eth_obj, 5, NULL);
+    #endif
     }
     else
     {
@@ -241,24 +533,27 @@ void ethernet_init (ethernet_obj_t * eth_obj)
 void ethernet_event_handler (void * arg, esp_event_base_t event_base,
                                 int32_t event_id, void * event_data) 
 {
-    ethernet_obj_t * eth_obj = NULL;
-
-    if (ETHERNET_EVENT_CONNECTED != event_id)
-    {
-        eth_obj = (ethernet_obj_t *)arg;
-    }
+    ethernet_obj_t * eth_obj = (ethernet_obj_t *)arg;
 
     if (event_base == ETH_EVENT && event_id == ETHERNET_EVENT_DISCONNECTED) 
     {
-        ethernet_shutdown(eth_obj);
+        /* Keep the driver installed, the netif glue restarts DHCP once the link is back */
+        network_supervisor_link_down(&eth_obj->supervisor);
     } 
+    else if (event_base == ETH_EVENT && event_id == ETHERNET_EVENT_CONNECTED) 
+    {
+        ESP_LOGI(LOG_TAG, "Ethernet Link Up");
+        network_supervisor_link_up(&eth_obj->supervisor);
+    #if CONFIG_LWIP_IPV6
+        esp_netif_create_ip6_linklocal(eth_obj->s_eth_netif);
+    #endif
+    }
     else if (event_base == IP_EVENT && event_id == IP_EVENT_ETH_GOT_IP) 
     {
         ip_event_got_ip_t * event = (ip_event_got_ip_t *)event_data;
         ESP_LOGI(LOG_TAG, "Got IPv4 event: Interface \"%s\" address: " IPSTR, 
                     esp_netif_get_desc(event->esp_netif), IP2STR(&event->ip_info.ip));
-        xEventGroupSetBits(eth_obj->ethernet_event_group, eth_obj->CONNECTED_BIT);
-        eth_obj->ethernet_status_flag = true;
+        network_supervisor_connected(&eth_obj->supervisor);
     }
     #if CONFIG_LWIP_IPV6
     else if (event_base == IP_EVENT && event_id == IP_EVENT_GOT_IP6) 
@@ -268,20 +563,29 @@ void ethernet_event_handler (void * arg, esp_event_base_t event_base,
         ESP_LOGI(LOG_TAG, "Got IPv6 event: Interface \"%s\" address: " IPV6STR ", type: %s", 
                             esp_netif_get_desc(event->esp_netif), IPV62STR(event->ip6_info.ip),
                             ipv6_addr_types_to_str[ipv6_type]);
-
-        if (ipv6_type == ESP_IP6_ADDR_IS_LINK_LOCAL) 
-        {
-            xEventGroupSetBits(eth_obj->ethernet_event_group, eth_obj->CONNECTED_BIT);
-            eth_obj->ethernet_status_flag = true;
-        }
+        /* A link-local address is not reachable for clients, only IPv4 counts as connected */
     }
-    else if (event_base == ETH_EVENT && event_id == ETHERNET_EVENT_CONNECTED) 
+    #endif
+}
+
+#if CONFIG_NETWORK_LINK_FLAP_INJECT
+/* Debug aid: drop and restore the link through the same events the driver posts */
+void link_flap_task (void * pvParameter)
+{
+    ethernet_obj_t * eth_obj = (ethernet_obj_t *)pvParameter;
+
+    while (1)
     {
-        ESP_LOGI(LOG_TAG, "Ethernet Link Up");
-        ESP_ERROR_CHECK(esp_netif_create_ip6_linklocal(arg));
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_NETWORK_LINK_FLAP_PERIOD_MS));
+        ESP_LOGI(LOG_TAG, "Injecting link down");
+        esp_event_post(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &eth_obj->s_eth_handle, 
+                        sizeof(esp_eth_handle_t), portMAX_DELAY);
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_NETWORK_LINK_FLAP_DOWN_MS));
+        esp_event_post(ETH_EVENT, ETHERNET_EVENT_CONNECTED, &eth_obj->s_eth_handle, 
+                        sizeof(esp_eth_handle_t), portMAX_DELAY);
     }
-    #endif
 }
+#endif
 
 /* tear down connection, release resources */
 void ethernet_shutdown (ethernet_obj_t * eth_obj)
@@ -296,9 +600,10 @@ void ethernet_shutdown (ethernet_obj_t * eth_obj)
     eth_obj->s_eth_mac->del(eth_obj->s_eth_mac);
 
     esp_event_handler_unregister(IP_EVENT, IP_EVENT_ETH_GOT_IP, &ethernet_event_handler);
+    esp_event_handler_unregister(ETH_EVENT, ETHERNET_EVENT_CONNECTED, &ethernet_event_handler);
+    esp_event_handler_unregister(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &ethernet_event_handler);
     #if CONFIG_LWIP_IPV6
         esp_event_handler_unregister(IP_EVENT, IP_EVENT_GOT_IP6, &ethernet_event_handler);
-        esp_event_handler_unregister(ETH_EVENT, ETHERNET_EVENT_CONNECTED, &ethernet_event_handler);
     #endif
     esp_event_loop_delete_default();
     ESP_LOGI(LOG_TAG, "Ethernet Shut Down");
@@ -316,6 +621,11 @@ void initialise_mdns(mdns_obj_t * mdns_cred)
         {"path", "/"}
     };
 
+    #if CONFIG_WEB_HTTPS_ENABLE
+    ESP_ERROR_CHECK(mdns_service_add("ESP32-WebServer", "_https", "_tcp", 443, serviceTxtData,
+                                     sizeof(serviceTxtData) / sizeof(serviceTxtData[0])));
+    #else
     ESP_ERROR_CHECK(mdns_service_add("ESP32-WebServer", "_http", "_tcp", 80, serviceTxtData,
                                      sizeof(serviceTxtData) / sizeof(serviceTxtData[0])));
+    #endif
 }
@@ -0,0 +1,32 @@
+#ifndef __OTA_UPDATE_H__
+#define __OTA_UPDATE_H__
+
+#include "esp_http_server.h"
+
+#define OTA_UPDATE_BUFFERS      CONFIG_OTA_UPDATE_BUFFERS
+#define OTA_UPDATE_BUFFER_SIZE  CONFIG_OTA_UPDATE_BUFFER_SIZE
+
+typedef enum
+{
+    OTA_STATE_IDLE = 0,
+    OTA_STATE_RECEIVING,
+    OTA_STATE_DONE,
+    OTA_STATE_FAILED
+} ota_state_t;
+
+typedef struct
+{
+    ota_state_t state;
+    size_t total;
+    size_t received;
+    size_t written;
+    int64_t elapsed_us;
+    esp_err_t last_err;
+} ota_update_status_t;
+
+//Functions
+esp_err_t ota_update_init (void);
+esp_err_t ota_update_post_handler (httpd_req_t * req);
+esp_err_t ota_update_get_handler (httpd_req_t * req);
+void ota_update_get_status (ota_update_status_t * status);
+#endif
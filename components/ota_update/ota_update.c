@@ -0,0 +1,373 @@
+#include "string.h"
+#include "sys/param.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "cJSON.h"
+#include "ota_update.h"
+#include "trace.h"
+
+#define LOG_TAG             "[ota_update]"
+#define OTA_RECV_RETRIES    (5)
+
+typedef struct
+{
+    int index;
+    size_t len;
+} ota_block_t;
+
+typedef struct
+{
+    SemaphoreHandle_t lock;
+    SemaphoreHandle_t done;
+    QueueHandle_t free_queue;
+    QueueHandle_t full_queue;
+    char * buf[OTA_UPDATE_BUFFERS];
+    esp_ota_handle_t ota_handle;
+    const esp_partition_t * partition;
+    int64_t start_us;
+    // Written by the receiving and the writer task, read by the httpd task
+    portMUX_TYPE status_lock;
+    ota_update_status_t status;
+} ota_update_obj_t;
+
+// Functions declaration
+void ota_writer_task (void * pvParameter);
+void ota_receive_task (void * pvParameter);
+void ota_reboot_cb (void * arg);
+static esp_err_t ota_update_receive (httpd_req_t * req);
+static esp_err_t ota_update_last_err (void);
+static void ota_update_set_err (esp_err_t err_ret);
+static esp_err_t ota_update_send_status (httpd_req_t * req);
+
+//Variables declaration
+static ota_update_obj_t s_ota;
+
+esp_err_t ota_update_init (void)
+{
+    memset(&s_ota, 0, sizeof(s_ota));
+    portMUX_INITIALIZE(&s_ota.status_lock);
+    /* Binary rather than a mutex, the upload is released by ota_receive_task */
+    s_ota.lock = xSemaphoreCreateBinary();
+    s_ota.done = xSemaphoreCreateBinary();
+    s_ota.free_queue = xQueueCreate(OTA_UPDATE_BUFFERS, sizeof(int));
+    s_ota.full_queue = xQueueCreate(OTA_UPDATE_BUFFERS + 1, sizeof(ota_block_t));
+
+    if ((NULL == s_ota.lock) || (NULL == s_ota.done) || 
+            (NULL == s_ota.free_queue) || (NULL == s_ota.full_queue))
+    {
+        ESP_LOGE(LOG_TAG, "Failed to create OTA queues");
+        return ESP_ERR_NO_MEM;
+    }
+    xSemaphoreGive(s_ota.lock);
+
+    for (int i = 0; i < OTA_UPDATE_BUFFERS; i++)
+    {
+        s_ota.buf[i] = malloc(OTA_UPDATE_BUFFER_SIZE);
+
+        if (NULL == s_ota.buf[i])
+        {
+            ESP_LOGE(LOG_TAG, "Failed to allocate OTA buffer");
+            return ESP_ERR_NO_MEM;
+        }
+        xQueueSend(s_ota.free_queue, &i, 0);
+    }
+
+    if (pdPASS != xTaskCreate(&ota_writer_task, "ota_writer", 4096, NULL, 5, NULL))
+    {
+        ESP_LOGE(LOG_TAG, "Failed to create OTA writer task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+/* Writes full buffers to flash while the receiving task fills the next one.
+ * A block with len 0 marks the end of an upload. */
+void ota_writer_task (void * pvParameter)
+{
+    ota_block_t block;
+
+    while (1)
+    {
+        xQueueReceive(s_ota.full_queue, &block, portMAX_DELAY);
+
+        if (0 == block.len)
+        {
+            xSemaphoreGive(s_ota.done);
+            continue;
+        }
+
+        if (ESP_OK == ota_update_last_err())
+        {
+            esp_err_t err_ret = esp_ota_write(s_ota.ota_handle, s_ota.buf[block.index], block.len);
+
+            taskENTER_CRITICAL(&s_ota.status_lock);
+            if (ESP_OK == err_ret)
+            {
+                s_ota.status.written += block.len;
+            }
+            else
+            {
+                s_ota.status.last_err = err_ret;
+            }
+            taskEXIT_CRITICAL(&s_ota.status_lock);
+
+            if (ESP_OK != err_ret)
+            {
+                ESP_LOGE(LOG_TAG, "esp_ota_write failed (%s)", esp_err_to_name(err_ret));
+            }
+        }
+        xQueueSend(s_ota.free_queue, &block.index, portMAX_DELAY);
+    }
+}
+
+void ota_reboot_cb (void * arg)
+{
+    esp_restart();
+}
+
+static esp_err_t ota_update_last_err (void)
+{
+    taskENTER_CRITICAL(&s_ota.status_lock);
+    esp_err_t err_ret = s_ota.status.last_err;
+    taskEXIT_CRITICAL(&s_ota.status_lock);
+    return err_ret;
+}
+
+static void ota_update_set_err (esp_err_t err_ret)
+{
+    taskENTER_CRITICAL(&s_ota.status_lock);
+    s_ota.status.last_err = err_ret;
+    taskEXIT_CRITICAL(&s_ota.status_lock);
+}
+
+/* Start an upload. The body is received by ota_receive_task on a copy of the request,
+ * so the httpd task stays free to answer GET /api/v1/ota with live progress. */
+esp_err_t ota_update_post_handler (httpd_req_t * req)
+{
+    httpd_req_t * async_req = NULL;
+
+    if (NULL == s_ota.lock)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "OTA update not initialized");
+        return ESP_FAIL;
+    }
+
+    if (pdTRUE != xSemaphoreTake(s_ota.lock, 0))
+    {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_sendstr(req, "OTA update already in progress");
+    }
+
+    s_ota.partition = esp_ota_get_next_update_partition(NULL);
+
+    if ((NULL == s_ota.partition) || (0 == req->content_len) || (req->content_len > s_ota.partition->size))
+    {
+        xSemaphoreGive(s_ota.lock);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Image does not fit the OTA partition");
+        return ESP_FAIL;
+    }
+
+    if ((ESP_OK == httpd_req_async_handler_begin(req, &async_req)) && 
+            (pdPASS == xTaskCreate(&ota_receive_task, "ota_receive", 4096, async_req, 5, NULL)))
+    {
+        return ESP_OK;
+    }
+
+    /* Out of memory for the task, receive on the httpd task without live progress */
+    if (NULL != async_req)
+    {
+        httpd_req_async_handler_complete(async_req);
+    }
+    return ota_update_receive(req);
+}
+
+void ota_receive_task (void * pvParameter)
+{
+    httpd_req_t * req = (httpd_req_t *)pvParameter;
+
+    ota_update_receive(req);
+    httpd_req_async_handler_complete(req);
+    vTaskDelete(NULL);
+}
+
+/* Stream the request body into the next OTA slot, called with s_ota.lock held */
+static esp_err_t ota_update_receive (httpd_req_t * req)
+{
+    const esp_partition_t * partition = s_ota.partition;
+    ota_block_t block;
+    int last_percent = 0;
+    int timeouts = 0;
+    size_t received_total = 0;
+    size_t total = req->content_len;
+
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err_ret = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &s_ota.ota_handle);
+    bool begun = (ESP_OK == err_ret);
+
+    taskENTER_CRITICAL(&s_ota.status_lock);
+    s_ota.start_us = start_us;
+    s_ota.status.state = OTA_STATE_RECEIVING;
+    s_ota.status.total = total;
+    s_ota.status.received = 0;
+    s_ota.status.written = 0;
+    s_ota.status.elapsed_us = 0;
+    s_ota.status.last_err = err_ret;
+    taskEXIT_CRITICAL(&s_ota.status_lock);
+    ESP_LOGI(LOG_TAG, "Writing %d bytes to partition %s", total, partition->label);
+
+    while ((ESP_OK == ota_update_last_err()) && (received_total < total))
+    {
+        xQueueReceive(s_ota.free_queue, &block.index, portMAX_DELAY);
+        block.len = 0;
+
+        /* Fill the whole buffer so flash is written in full sectors */
+        while ((block.len < OTA_UPDATE_BUFFER_SIZE) && (received_total + block.len < total))
+        {
+            int received = httpd_req_recv(req, s_ota.buf[block.index] + block.len, 
+                                            MIN(OTA_UPDATE_BUFFER_SIZE - block.len, 
+                                                total - received_total - block.len));
+
+            if ((HTTPD_SOCK_ERR_TIMEOUT == received) && (++timeouts < OTA_RECV_RETRIES))
+            {
+                continue;
+            }
+            else if (received <= 0)
+            {
+                ota_update_set_err(ESP_ERR_INVALID_SIZE);
+                break;
+            }
+            /* Only consecutive timeouts abort, a slow upload may time out now and then */
+            timeouts = 0;
+            block.len += received;
+        }
+
+        if (block.len > 0)
+        {
+            received_total += block.len;
+            taskENTER_CRITICAL(&s_ota.status_lock);
+            s_ota.status.received = received_total;
+            taskEXIT_CRITICAL(&s_ota.status_lock);
+            xQueueSend(s_ota.full_queue, &block, portMAX_DELAY);
+        }
+        else
+        {
+            xQueueSend(s_ota.free_queue, &block.index, portMAX_DELAY);
+        }
+
+        int percent = (received_total * 100) / total;
+
+        if (percent >= last_percent + 10)
+        {
+            last_percent = percent;
+            ESP_LOGI(LOG_TAG, "Received %d%%", percent);
+        }
+    }
+
+    /* Wait for the writer to flush the last buffers */
+    block.index = -1;
+    block.len = 0;
+    xQueueSend(s_ota.full_queue, &block, portMAX_DELAY);
+    xSemaphoreTake(s_ota.done, portMAX_DELAY);
+    err_ret = ota_update_last_err();
+
+    if (ESP_OK == err_ret)
+    {
+        err_ret = esp_ota_end(s_ota.ota_handle);
+    }
+    else if (true == begun)
+    {
+        esp_ota_abort(s_ota.ota_handle);
+    }
+
+    if (ESP_OK == err_ret)
+    {
+        err_ret = esp_ota_set_boot_partition(partition);
+    }
+
+    taskENTER_CRITICAL(&s_ota.status_lock);
+    s_ota.status.last_err = err_ret;
+    s_ota.status.elapsed_us = esp_timer_get_time() - start_us;
+    s_ota.status.state = (ESP_OK == err_ret) ? OTA_STATE_DONE : OTA_STATE_FAILED;
+    ota_update_status_t status = s_ota.status;
+    taskEXIT_CRITICAL(&s_ota.status_lock);
+
+    ESP_LOGI(LOG_TAG, "OTA %s: %d bytes in %lld us (%.2f MB/s)", 
+                (OTA_STATE_DONE == status.state) ? "done" : "failed", status.written,
+                status.elapsed_us, (status.elapsed_us > 0) ? 
+                (double)status.written / status.elapsed_us : 0.0);
+    xSemaphoreGive(s_ota.lock);
+
+    if (OTA_STATE_DONE != status.state)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(status.last_err));
+        return ESP_FAIL;
+    }
+
+    ota_update_send_status(req);
+    #if CONFIG_OTA_UPDATE_REBOOT
+    /* Give the response time to leave before rebooting */
+    const esp_timer_create_args_t reboot_timer_args = 
+    {
+        .callback = ota_reboot_cb,
+        .name = "ota_reboot"
+    };
+    esp_timer_handle_t reboot_timer;
+
+    if (ESP_OK == esp_timer_create(&reboot_timer_args, &reboot_timer))
+    {
+        esp_timer_start_once(reboot_timer, 1000 * 1000);
+    }
+    #endif
+    return ESP_OK;
+}
+
+/* Report the progress and throughput of the current or last upload */
+esp_err_t ota_update_get_handler (httpd_req_t * req)
+{
+    return ota_update_send_status(req);
+}
+
+static esp_err_t ota_update_send_status (httpd_req_t * req)
+{
+    static const char * state_str[] = {"idle", "receiving", "done", "failed"};
+    ota_update_status_t status;
+    ota_update_get_status(&status);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "state", state_str[status.state]);
+    cJSON_AddNumberToObject(root, "total", status.total);
+    cJSON_AddNumberToObject(root, "received", status.received);
+    cJSON_AddNumberToObject(root, "written", status.written);
+    cJSON_AddNumberToObject(root, "elapsed_us", status.elapsed_us);
+    cJSON_AddNumberToObject(root, "mbps", (status.elapsed_us > 0) ? 
+                                (double)status.written / status.elapsed_us : 0.0);
+    cJSON_AddStringToObject(root, "error", esp_err_to_name(status.last_err));
+    TRACE_SPAN_BEGIN(span);
+    const char * json = cJSON_Print(root);
+    TRACE_SPAN_END(span, "cjson_print", (NULL != json) ? strlen(json) : 0);
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err_ret = httpd_resp_sendstr(req, json);
+    free((void *)json);
+    cJSON_Delete(root);
+    return err_ret;
+}
+
+void ota_update_get_status (ota_update_status_t * status)
+{
+    taskENTER_CRITICAL(&s_ota.status_lock);
+    *status = s_ota.status;
+    int64_t start_us = s_ota.start_us;
+    taskEXIT_CRITICAL(&s_ota.status_lock);
+
+    if (OTA_STATE_RECEIVING == status->state)
+    {
+        status->elapsed_us = esp_timer_get_time() - start_us;
+    }
+}
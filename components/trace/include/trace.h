@@ -0,0 +1,39 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "sdkconfig.h"
+#include "esp_http_server.h"
+
+/* Spans are timed with the cycle counter of the core they started on, or with esp_timer
+ * when they end on the other core or DFS may change the CPU clock. Names must be string
+ * literals. All events carry the id of the HTTP request being handled. */
+#if CONFIG_TRACE_ENABLE
+#include "esp_cpu.h"
+#include "esp_timer.h"
+typedef struct
+{
+    uint32_t cycles;
+    uint32_t core;
+    int64_t start_us;
+} trace_span_t;
+
+#define TRACE_SPAN_BEGIN(span)          trace_span_t span = {esp_cpu_get_cycle_count(), esp_cpu_get_core_id(), \
+                                                                esp_timer_get_time()}
+#define TRACE_SPAN_END(span, name, arg) trace_write(name, &span, (uint32_t)(arg))
+#define TRACE_INSTANT(name, arg)        trace_write(name, NULL, (uint32_t)(arg))
+#define TRACE_REQUEST_BEGIN()           trace_request_begin()
+#else
+#define TRACE_SPAN_BEGIN(span)
+#define TRACE_SPAN_END(span, name, arg)
+#define TRACE_INSTANT(name, arg)
+#define TRACE_REQUEST_BEGIN()
+#endif
+
+//Functions
+esp_err_t trace_init (void);
+#if CONFIG_TRACE_ENABLE
+void trace_write (const char * name, const trace_span_t * span, uint32_t arg);
+void trace_request_begin (void);
+#endif
+esp_err_t trace_get_handler (httpd_req_t * req);
+#endif
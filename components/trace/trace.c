@@ -0,0 +1,174 @@
+#include "string.h"
+#include "stdio.h"
+#include "sys/param.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include "esp_log.h"
+#include "trace.h"
+
+#define LOG_TAG             "[trace]"
+#define TRACE_BENCH_SPANS   (1000)
+#define TRACE_LINE_LEN      (192)
+
+#if CONFIG_TRACE_ENABLE
+#define TRACE_MASK          (CONFIG_TRACE_EVENTS - 1)
+_Static_assert((CONFIG_TRACE_EVENTS & TRACE_MASK) == 0, "TRACE_EVENTS must be a power of two");
+
+typedef struct
+{
+    // head + 1 of the reservation once the event is complete, 0 while it is written
+    uint32_t seq;
+    const char * name;
+    int64_t end_us;
+    float dur_us;
+    uint32_t arg;
+    uint16_t request;
+    uint8_t core;
+    // 'X' complete span, 'i' instant
+    char phase;
+    // Span ended on another core than it started on
+    bool moved;
+} trace_event_t;
+
+typedef struct
+{
+    uint32_t head;
+    uint32_t request;
+    uint32_t span_cycles;
+    trace_event_t event[CONFIG_TRACE_EVENTS];
+} trace_obj_t;
+
+//Variables declaration
+static trace_obj_t s_trace;
+#endif
+
+/* Measure the cost of one span with the recorder enabled, then start from an empty buffer */
+esp_err_t trace_init (void)
+{
+    #if CONFIG_TRACE_ENABLE
+    uint32_t start = esp_cpu_get_cycle_count();
+
+    for (int i = 0; i < TRACE_BENCH_SPANS; i++)
+    {
+        TRACE_SPAN_BEGIN(span);
+        TRACE_SPAN_END(span, "trace_bench", i);
+    }
+    s_trace.span_cycles = (esp_cpu_get_cycle_count() - start) / TRACE_BENCH_SPANS;
+    memset(s_trace.event, 0, sizeof(s_trace.event));
+    __atomic_store_n(&s_trace.head, 0, __ATOMIC_RELEASE);
+    ESP_LOGI(LOG_TAG, "%d events, %lu cycles per span", CONFIG_TRACE_EVENTS, s_trace.span_cycles);
+    #endif
+    return ESP_OK;
+}
+
+#if CONFIG_TRACE_ENABLE
+/* Hot path: claim the next slot, the oldest event is overwritten */
+void trace_write (const char * name, const trace_span_t * span, uint32_t arg)
+{
+    uint32_t end_cycles = esp_cpu_get_cycle_count();
+    int64_t end_us = esp_timer_get_time();
+    uint32_t core = esp_cpu_get_core_id();
+    uint32_t head = __atomic_fetch_add(&s_trace.head, 1, __ATOMIC_RELAXED);
+    trace_event_t * event = &s_trace.event[head & TRACE_MASK];
+
+    __atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    event->name = name;
+    event->end_us = end_us;
+    event->arg = arg;
+    event->request = (uint16_t)__atomic_load_n(&s_trace.request, __ATOMIC_RELAXED);
+    event->core = core;
+    event->dur_us = 0;
+    event->phase = 'i';
+    event->moved = false;
+
+    if (NULL != span)
+    {
+        event->phase = 'X';
+        event->moved = (span->core != core);
+        #if CONFIG_PM_ENABLE
+        /* DFS changes the cycle counter rate during a span */
+        event->dur_us = (float)(end_us - span->start_us);
+        #else
+        /* Cycle counters of the two cores are not synchronized */
+        event->dur_us = (span->core == core) ? 
+                            (float)(end_cycles - span->cycles) / esp_rom_get_cpu_ticks_per_us() : 
+                            (float)(end_us - span->start_us);
+        #endif
+    }
+    __atomic_store_n(&event->seq, head + 1, __ATOMIC_RELEASE);
+}
+
+/* Called by the httpd task when a request is dispatched */
+void trace_request_begin (void)
+{
+    __atomic_fetch_add(&s_trace.request, 1, __ATOMIC_RELAXED);
+}
+#endif
+
+/* Flight recorder content, oldest first, in Chrome trace-event JSON */
+esp_err_t trace_get_handler (httpd_req_t * req)
+{
+    #if CONFIG_TRACE_ENABLE
+    char line[TRACE_LINE_LEN];
+    trace_event_t event;
+    const char * sep = "";
+    uint32_t head = __atomic_load_n(&s_trace.head, __ATOMIC_ACQUIRE);
+    uint32_t first = (head > CONFIG_TRACE_EVENTS) ? (head - CONFIG_TRACE_EVENTS) : 0;
+    esp_err_t err_ret;
+
+    httpd_resp_set_type(req, "application/json");
+    err_ret = httpd_resp_send_chunk(req, "{\"traceEvents\":[", HTTPD_RESP_USE_STRLEN);
+
+    for (uint32_t i = first; (ESP_OK == err_ret) && (i < head); i++)
+    {
+        trace_event_t * slot = &s_trace.event[i & TRACE_MASK];
+
+        /* Skip events that are being written or were overwritten while copying */
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != i + 1)
+        {
+            continue;
+        }
+        event = *slot;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != i + 1)
+        {
+            continue;
+        }
+
+        int len;
+
+        if ('X' == event.phase)
+        {
+            len = snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                            "\"pid\":1,\"tid\":%u,\"args\":{\"req\":%u,\"arg\":%lu,\"moved\":%d}}", sep, 
+                            event.name, (double)event.end_us - event.dur_us, (double)event.dur_us, 
+                            event.core, event.request, event.arg, event.moved);
+        }
+        else
+        {
+            len = snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,"
+                            "\"pid\":1,\"tid\":%u,\"args\":{\"req\":%u,\"arg\":%lu}}", sep, 
+                            event.name, event.end_us, event.core, event.request, event.arg);
+        }
+        err_ret = httpd_resp_send_chunk(req, line, MIN(len, sizeof(line) - 1));
+        sep = ",";
+    }
+
+    if (ESP_OK == err_ret)
+    {
+        snprintf(line, sizeof(line), "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"span_cycles\":%lu,"
+                    "\"cpu_mhz\":%lu,\"written\":%lu}}", s_trace.span_cycles, 
+                    esp_rom_get_cpu_ticks_per_us(), head);
+        httpd_resp_send_chunk(req, line, HTTPD_RESP_USE_STRLEN);
+        err_ret = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return err_ret;
+    #else
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Tracing is disabled");
+    return ESP_OK;
+    #endif
+}
@@ -0,0 +1,45 @@
+#ifndef __VFS_INDEX_H__
+#define __VFS_INDEX_H__
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "stdbool.h"
+#include "stdint.h"
+#include "stddef.h"
+#include "time.h"
+
+#define VFS_INDEX_URI_LEN       (64)
+#define VFS_INDEX_MAX_FILES     CONFIG_WEB_INDEX_MAX_FILES
+/* Release slots of the asset updater, top level directories of the mount point */
+#define VFS_INDEX_SLOT_A        "slot_a"
+#define VFS_INDEX_SLOT_B        "slot_b"
+
+typedef struct
+{
+    char uri[VFS_INDEX_URI_LEN];
+    uint32_t uri_hash;
+    size_t size;
+    time_t mtime;
+    char etag[12];
+    // File contents when preloaded, NULL otherwise
+    char * data;
+} vfs_index_entry_t;
+
+typedef struct
+{
+    bool done;
+    int64_t warmup_us;
+    size_t preloaded_bytes;
+    int indexed_files;
+    int preloaded_files;
+} vfs_index_stats_t;
+
+typedef void (*vfs_index_done_cb_t)(void * p_ctx);
+
+//Functions
+esp_err_t vfs_index_start (const char * mount_point, vfs_index_done_cb_t fp_done, void * p_ctx);
+bool vfs_index_running (void);
+bool vfs_index_is_reserved (const char * uri);
+const vfs_index_entry_t * vfs_index_find (const char * uri);
+void vfs_index_get_stats (vfs_index_stats_t * stats);
+#endif
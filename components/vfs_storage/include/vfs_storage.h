@@ -5,4 +5,5 @@
 
 //Functions
 esp_err_t init_vfs (webpage_obj_t * server_cred);
+esp_err_t vfs_storage_free_bytes (const char * base_path, uint64_t * free_bytes);
 #endif
\ No newline at end of file
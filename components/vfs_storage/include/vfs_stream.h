@@ -0,0 +1,29 @@
+#ifndef __VFS_STREAM_H__
+#define __VFS_STREAM_H__
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "stdint.h"
+#include "stddef.h"
+
+#define VFS_STREAM_BUFFERS      CONFIG_WEB_STREAM_BUFFERS
+#if CONFIG_WEB_DEPLOY_SD
+#define VFS_STREAM_BLOCK_SIZE   CONFIG_WEB_SD_ALLOCATION_UNIT_SIZE
+#else
+#define VFS_STREAM_BLOCK_SIZE   CONFIG_WEB_STREAM_BLOCK_SIZE
+#endif
+
+typedef esp_err_t (*vfs_stream_sink_t)(void * p_ctx, const char * data, size_t len);
+
+typedef struct
+{
+    size_t bytes;
+    int64_t elapsed_us;
+} vfs_stream_stats_t;
+
+//Functions
+esp_err_t vfs_stream_init (size_t block_size);
+esp_err_t vfs_stream_file (int fd, vfs_stream_sink_t fp_sink, void * p_ctx, 
+                                vfs_stream_stats_t * stats);
+size_t vfs_stream_block_size (void);
+#endif
@@ -0,0 +1,317 @@
+#include "string.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "dirent.h"
+#include "unistd.h"
+#include "fcntl.h"
+#include "sys/stat.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "trace.h"
+#include "esp_vfs.h"
+#include "esp_log.h"
+#include "vfs_index.h"
+
+#define LOG_TAG             "[vfs_index]"
+#define VFS_INDEX_MAX_DEPTH (4)
+
+typedef struct
+{
+    char mount_point[48];
+    vfs_index_done_cb_t fp_done;
+    void * p_ctx;
+    int count;
+    vfs_index_entry_t entry[VFS_INDEX_MAX_FILES];
+    vfs_index_stats_t stats;
+    // Set once the warm-up task has finished writing the index
+    bool ready;
+} vfs_index_obj_t;
+
+// Functions declaration
+void vfs_index_task (void * pvParameter);
+static uint32_t vfs_index_hash (const char * str, size_t len);
+static uint32_t vfs_index_hash_update (uint32_t hash, const void * data, size_t len);
+static void vfs_index_walk (char * path, size_t path_len, int depth);
+static void vfs_index_preload (vfs_index_entry_t * entry, size_t * budget);
+static void vfs_index_load_manifest (size_t * budget);
+
+//Variables declaration
+static vfs_index_obj_t s_index;
+static volatile bool s_running = false;
+
+/* Start the warm-up task on the core not used by app_main so the server start is not delayed.
+ * Calling it again rebuilds the index for a new root, lookups miss until it is done.
+ * The caller must make sure no entry returned by vfs_index_find is still in use. */
+esp_err_t vfs_index_start (const char * mount_point, vfs_index_done_cb_t fp_done, void * p_ctx)
+{
+    if (true == s_running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    __atomic_store_n(&s_index.ready, false, __ATOMIC_RELEASE);
+
+    for (int i = 0; i < s_index.count; i++)
+    {
+        free(s_index.entry[i].data);
+    }
+    memset(&s_index, 0, sizeof(s_index));
+    s_running = true;
+    strlcpy(s_index.mount_point, mount_point, sizeof(s_index.mount_point));
+    s_index.fp_done = fp_done;
+    s_index.p_ctx = p_ctx;
+
+    if (pdPASS != xTaskCreatePinnedToCore(&vfs_index_task, "vfs_index", 4096, NULL, 
+                    tskIDLE_PRIORITY + 1, NULL, (portNUM_PROCESSORS > 1) ? 1 : tskNO_AFFINITY))
+    {
+        ESP_LOGE(LOG_TAG, "Failed to create warm-up task");
+        s_running = false;
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+void vfs_index_task (void * pvParameter)
+{
+    char path[ESP_VFS_PATH_MAX + VFS_INDEX_URI_LEN];
+    size_t budget = CONFIG_WEB_PRELOAD_MAX_BYTES;
+    int64_t start_us = esp_timer_get_time();
+
+    strlcpy(path, s_index.mount_point, sizeof(path));
+    vfs_index_walk(path, sizeof(path), 0);
+
+    for (int i = 0; i < s_index.count; i++)
+    {
+        if (0 == strcmp(s_index.entry[i].uri, "/index.html"))
+        {
+            vfs_index_preload(&s_index.entry[i], &budget);
+        }
+    }
+    vfs_index_load_manifest(&budget);
+
+    s_index.stats.indexed_files = s_index.count;
+    s_index.stats.warmup_us = esp_timer_get_time() - start_us;
+    s_index.stats.done = true;
+    __atomic_store_n(&s_index.ready, true, __ATOMIC_RELEASE);
+    ESP_LOGI(LOG_TAG, "Warm-up done in %lld us: %d files indexed, %d preloaded (%d bytes)", 
+                s_index.stats.warmup_us, s_index.stats.indexed_files, 
+                s_index.stats.preloaded_files, s_index.stats.preloaded_bytes);
+
+    if (NULL != s_index.fp_done)
+    {
+        s_index.fp_done(s_index.p_ctx);
+    }
+    s_running = false;
+    vTaskDelete(NULL);
+}
+
+/* FNV-1a, only used to skip string compares on lookup */
+static uint32_t vfs_index_hash (const char * str, size_t len)
+{
+    return vfs_index_hash_update(2166136261u, str, len);
+}
+
+static uint32_t vfs_index_hash_update (uint32_t hash, const void * data, size_t len)
+{
+    const uint8_t * p_data = (const uint8_t *)data;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ p_data[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/* Add every regular file below path to the index, path is used as scratch */
+static void vfs_index_walk (char * path, size_t path_len, int depth)
+{
+    size_t base_len = strlen(path);
+    size_t mount_len = strlen(s_index.mount_point);
+    DIR * dir = opendir(path);
+    struct dirent * dir_entry;
+    struct stat st;
+
+    if (NULL == dir)
+    {
+        ESP_LOGE(LOG_TAG, "Failed to open directory %s", path);
+        return;
+    }
+
+    while ((NULL != (dir_entry = readdir(dir))) && (s_index.count < VFS_INDEX_MAX_FILES))
+    {
+        snprintf(path + base_len, path_len - base_len, "/%s", dir_entry->d_name);
+
+        if (vfs_index_is_reserved(path + mount_len))
+        {
+            continue;
+        }
+
+        if (0 != stat(path, &st))
+        {
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode) && (depth < VFS_INDEX_MAX_DEPTH))
+        {
+            vfs_index_walk(path, path_len, depth + 1);
+        }
+        else if (S_ISREG(st.st_mode) && (strlen(path + mount_len) < VFS_INDEX_URI_LEN))
+        {
+            vfs_index_entry_t * entry = &s_index.entry[s_index.count++];
+            strlcpy(entry->uri, path + mount_len, sizeof(entry->uri));
+            entry->uri_hash = vfs_index_hash(entry->uri, strlen(entry->uri));
+            entry->size = st.st_size;
+            entry->mtime = st.st_mtime;
+            /* Size and mtime go through the hash, XOR-ing them in lets edits collide */
+            uint64_t size = (uint64_t)entry->size;
+            int64_t mtime = (int64_t)entry->mtime;
+            uint32_t etag = vfs_index_hash_update(entry->uri_hash, &size, sizeof(size));
+            etag = vfs_index_hash_update(etag, &mtime, sizeof(mtime));
+            snprintf(entry->etag, sizeof(entry->etag), "\"%08lx\"", (unsigned long)etag);
+            entry->data = NULL;
+        }
+    }
+
+    path[base_len] = '\0';
+    closedir(dir);
+}
+
+static void vfs_index_preload (vfs_index_entry_t * entry, size_t * budget)
+{
+    char path[ESP_VFS_PATH_MAX + VFS_INDEX_URI_LEN];
+
+    if ((NULL != entry->data) || (0 == entry->size) || (entry->size > *budget))
+    {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s%s", s_index.mount_point, entry->uri);
+    char * data = malloc(entry->size);
+    int fd = open(path, O_RDONLY, 0);
+    size_t total = 0;
+    ssize_t read_bytes = 0;
+
+    TRACE_SPAN_BEGIN(span);
+
+    if ((NULL != data) && (-1 != fd))
+    {
+        do
+        {
+            read_bytes = read(fd, data + total, entry->size - total);
+            total += (read_bytes > 0) ? read_bytes : 0;
+        } while ((read_bytes > 0) && (total < entry->size));
+    }
+    TRACE_SPAN_END(span, "vfs_preload", total);
+
+    if (-1 != fd)
+    {
+        close(fd);
+    }
+
+    if ((NULL != data) && (total == entry->size))
+    {
+        entry->data = data;
+        *budget -= entry->size;
+        s_index.stats.preloaded_bytes += entry->size;
+        s_index.stats.preloaded_files++;
+    }
+    else
+    {
+        ESP_LOGE(LOG_TAG, "Failed to preload %s", path);
+        free(data);
+    }
+}
+
+/* The manifest lists one URI per line, e.g. /assets/index.js */
+static void vfs_index_load_manifest (size_t * budget)
+{
+    char line[VFS_INDEX_URI_LEN + 2];
+    char path[ESP_VFS_PATH_MAX + VFS_INDEX_URI_LEN];
+
+    snprintf(path, sizeof(path), "%s/%s", s_index.mount_point, CONFIG_WEB_PRELOAD_MANIFEST);
+    FILE * manifest = fopen(path, "r");
+
+    if (NULL == manifest)
+    {
+        return;
+    }
+
+    while (NULL != fgets(line, sizeof(line), manifest))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        uint32_t hash = vfs_index_hash(line, strlen(line));
+
+        for (int i = 0; i < s_index.count; i++)
+        {
+            if ((hash == s_index.entry[i].uri_hash) && (0 == strcmp(line, s_index.entry[i].uri)))
+            {
+                vfs_index_preload(&s_index.entry[i], budget);
+                break;
+            }
+        }
+    }
+
+    fclose(manifest);
+}
+
+bool vfs_index_running (void)
+{
+    return s_running;
+}
+
+/* Hidden entries (pointer file, manifests, "..") and the release slots are never
+ * indexed or served, uri is relative to the served root */
+bool vfs_index_is_reserved (const char * uri)
+{
+    for (const char * p_sep = strchr(uri, '/'); NULL != p_sep; p_sep = strchr(p_sep + 1, '/'))
+    {
+        if ('.' == p_sep[1])
+        {
+            return true;
+        }
+    }
+
+    size_t first_len = strcspn(uri + 1, "/");
+
+    return ('/' == uri[0]) && 
+            (((strlen(VFS_INDEX_SLOT_A) == first_len) && (0 == strncmp(uri + 1, VFS_INDEX_SLOT_A, first_len))) || 
+            ((strlen(VFS_INDEX_SLOT_B) == first_len) && (0 == strncmp(uri + 1, VFS_INDEX_SLOT_B, first_len))));
+}
+
+/* Look up uri (relative to the mount point), NULL until the warm-up has finished */
+const vfs_index_entry_t * vfs_index_find (const char * uri)
+{
+    if (true != __atomic_load_n(&s_index.ready, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+
+    size_t len = strcspn(uri, "?");
+    uint32_t hash = vfs_index_hash(uri, len);
+
+    for (int i = 0; i < s_index.count; i++)
+    {
+        if ((hash == s_index.entry[i].uri_hash) && (strlen(s_index.entry[i].uri) == len) && 
+                (0 == strncmp(uri, s_index.entry[i].uri, len)))
+        {
+            return &s_index.entry[i];
+        }
+    }
+
+    return NULL;
+}
+
+void vfs_index_get_stats (vfs_index_stats_t * stats)
+{
+    if (true == __atomic_load_n(&s_index.ready, __ATOMIC_ACQUIRE))
+    {
+        *stats = s_index.stats;
+    }
+    else
+    {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
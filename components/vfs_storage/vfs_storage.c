@@ -4,15 +4,31 @@
 #include "vfs_storage.h"
 #include "sdmmc_cmd.h"
 #include "esp_log.h"
+#include "vfs_stream.h"
+#include "trace.h"
 #if CONFIG_WEB_DEPLOY_SD
 #include "driver/sdmmc_host.h"
+#include "esp_timer.h"
+#include "esp_vfs.h"
+#include "string.h"
+#include "sys/stat.h"
+#include "fcntl.h"
 #endif
 
 #define LOG_TAG     "[vfs_storage]"
 
+#if CONFIG_WEB_DEPLOY_SD
+#define SD_LEGACY_READ_SIZE     (10240)
+
+// Functions declaration
+void sd_io_benchmark (const char * filepath);
+esp_err_t sd_io_discard_sink (void * p_ctx, const char * data, size_t len);
+#endif
+
 esp_err_t init_vfs(webpage_obj_t * server_cred)
 {
     esp_err_t err_ret = ESP_FAIL;
+    TRACE_SPAN_BEGIN(span);
 
     #if CONFIG_WEB_DEPLOY_SEMIHOST
     err_ret = esp_vfs_semihost_register(server_cred->web_mount_point);
@@ -69,12 +85,25 @@ esp_err_t init_vfs(webpage_obj_t * server_cred)
     #elif CONFIG_WEB_DEPLOY_SD
     sdmmc_host_t host = SDMMC_HOST_DEFAULT();
     sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
+    char largest_file[ESP_VFS_PATH_MAX + 256] = {0};
+    off_t largest_size = 0;
+
+    #if CONFIG_WEB_SD_BUS_WIDTH_1
+    slot_config.width = 1;
+    #else
+    slot_config.width = 4;
+    #endif
+    #if CONFIG_WEB_SD_HIGH_SPEED
+    host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
+    #else
+    host.max_freq_khz = SDMMC_FREQ_DEFAULT;
+    #endif
 
     esp_vfs_fat_sdmmc_mount_config_t mount_config = 
     {
         .format_if_mount_failed = true,
         .max_files = 20,
-        .allocation_unit_size = 16 * 1024
+        .allocation_unit_size = CONFIG_WEB_SD_ALLOCATION_UNIT_SIZE
     };
 
     sdmmc_card_t * card;
@@ -106,14 +135,115 @@ esp_err_t init_vfs(webpage_obj_t * server_cred)
         else
         {
             struct dirent * entry;
+            struct stat st;
+            char filepath[sizeof(largest_file)];
+
             while ((entry = readdir(dir)) != NULL) 
             {
                 ESP_LOGI(LOG_TAG, "Found file: %s", entry->d_name);
+                snprintf(filepath, sizeof(filepath), "%s/%s", 
+                            server_cred->web_mount_point, entry->d_name);
+
+                if ((0 == stat(filepath, &st)) && S_ISREG(st.st_mode) && (st.st_size > largest_size))
+                {
+                    largest_size = st.st_size;
+                    strlcpy(largest_file, filepath, sizeof(largest_file));
+                }
             }
         
             closedir(dir);
         }
     }
     #endif
+    TRACE_SPAN_END(span, "vfs_mount", err_ret);
+
+    if (ESP_OK == err_ret)
+    {
+        /* Blocks are read into DMA capable buffers ahead of the sender, in SD mode
+         * a block is a whole cluster */
+        err_ret = vfs_stream_init(VFS_STREAM_BLOCK_SIZE);
+    }
+
+    #if CONFIG_WEB_SD_IO_BENCHMARK
+    if ((ESP_OK == err_ret) && (largest_size > 0))
+    {
+        sd_io_benchmark(largest_file);
+    }
+    #endif
     return err_ret;
-}
\ No newline at end of file
+}
+
+/* Space left on the web storage, not available for semihosting */
+esp_err_t vfs_storage_free_bytes (const char * base_path, uint64_t * free_bytes)
+{
+    esp_err_t err_ret = ESP_ERR_NOT_SUPPORTED;
+
+    #if CONFIG_WEB_DEPLOY_SF
+    size_t total = 0, used = 0;
+
+    err_ret = esp_littlefs_info("storage", &total, &used);
+    *free_bytes = (ESP_OK == err_ret) ? (total - used) : 0;
+    #elif CONFIG_WEB_DEPLOY_SD
+    uint64_t total = 0;
+
+    err_ret = esp_vfs_fat_info(base_path, &total, free_bytes);
+    #endif
+    return err_ret;
+}
+
+#if CONFIG_WEB_DEPLOY_SD
+esp_err_t sd_io_discard_sink (void * p_ctx, const char * data, size_t len)
+{
+    return ESP_OK;
+}
+
+/* Compare the plain serial read loop with the cluster aligned read-ahead stream */
+void sd_io_benchmark (const char * filepath)
+{
+    size_t bytes = 0;
+    ssize_t read_bytes;
+    vfs_stream_stats_t stats = {0};
+    char * buf = malloc(SD_LEGACY_READ_SIZE);
+    int fd = open(filepath, O_RDONLY, 0);
+
+    if ((NULL == buf) || (-1 == fd))
+    {
+        ESP_LOGE(LOG_TAG, "Failed to prepare benchmark on %s", filepath);
+        free(buf);
+
+        if (-1 != fd)
+        {
+            close(fd);
+        }
+        return;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+
+    do
+    {
+        read_bytes = read(fd, buf, SD_LEGACY_READ_SIZE);
+        bytes += (read_bytes > 0) ? read_bytes : 0;
+    } while (read_bytes > 0);
+
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    close(fd);
+    free(buf);
+    ESP_LOGI(LOG_TAG, "%s: %d bytes, %d byte reads: %.2f MB/s", filepath, bytes, 
+                SD_LEGACY_READ_SIZE, (elapsed_us > 0) ? (double)bytes / elapsed_us : 0.0);
+
+    fd = open(filepath, O_RDONLY, 0);
+
+    if ((-1 != fd) && (ESP_OK == vfs_stream_file(fd, sd_io_discard_sink, NULL, &stats)))
+    {
+        ESP_LOGI(LOG_TAG, "%s: %d bytes, %d byte read-ahead: %.2f MB/s", filepath, stats.bytes, 
+                    vfs_stream_block_size(), 
+                    (stats.elapsed_us > 0) ? (double)stats.bytes / stats.elapsed_us : 0.0);
+    }
+
+    if (-1 != fd)
+    {
+        close(fd);
+    }
+}
+#endif
\ No newline at end of file
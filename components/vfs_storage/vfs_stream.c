@@ -0,0 +1,161 @@
+#include "string.h"
+#include "unistd.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "vfs_stream.h"
+#include "log_ring.h"
+#include "trace.h"
+
+#define LOG_TAG     "[vfs_stream]"
+
+typedef struct
+{
+    int index;
+    ssize_t len;
+} vfs_stream_block_t;
+
+typedef struct
+{
+    SemaphoreHandle_t lock;
+    QueueHandle_t job_queue;
+    QueueHandle_t free_queue;
+    QueueHandle_t full_queue;
+    char * buf[VFS_STREAM_BUFFERS];
+    size_t block_size;
+    volatile bool abort;
+} vfs_stream_obj_t;
+
+// Functions declaration
+void vfs_stream_reader_task (void * pvParameter);
+
+//Variables declaration
+static vfs_stream_obj_t s_stream;
+
+/* Allocate DMA capable block buffers and start the read-ahead task.
+ * block_size should be a multiple of the file system cluster so reads never straddle one. */
+esp_err_t vfs_stream_init (size_t block_size)
+{
+    s_stream.block_size = block_size;
+    s_stream.abort = false;
+    s_stream.lock = xSemaphoreCreateMutex();
+    s_stream.job_queue = xQueueCreate(1, sizeof(int));
+    s_stream.free_queue = xQueueCreate(VFS_STREAM_BUFFERS, sizeof(int));
+    s_stream.full_queue = xQueueCreate(VFS_STREAM_BUFFERS, sizeof(vfs_stream_block_t));
+
+    if ((NULL == s_stream.lock) || (NULL == s_stream.job_queue) || 
+            (NULL == s_stream.free_queue) || (NULL == s_stream.full_queue))
+    {
+        ESP_LOGE(LOG_TAG, "Failed to create stream queues");
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < VFS_STREAM_BUFFERS; i++)
+    {
+        s_stream.buf[i] = heap_caps_malloc(block_size, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+
+        if (NULL == s_stream.buf[i])
+        {
+            ESP_LOGE(LOG_TAG, "Failed to allocate %d byte stream buffer", block_size);
+            return ESP_ERR_NO_MEM;
+        }
+        xQueueSend(s_stream.free_queue, &i, 0);
+    }
+
+    if (pdPASS != xTaskCreate(&vfs_stream_reader_task, "vfs_stream", 4096, NULL, 5, NULL))
+    {
+        ESP_LOGE(LOG_TAG, "Failed to create stream reader task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+size_t vfs_stream_block_size (void)
+{
+    return s_stream.block_size;
+}
+
+/* Fills free buffers from the current file until EOF, an error or an abort */
+void vfs_stream_reader_task (void * pvParameter)
+{
+    int fd;
+    vfs_stream_block_t block;
+
+    while (1)
+    {
+        xQueueReceive(s_stream.job_queue, &fd, portMAX_DELAY);
+
+        do
+        {
+            xQueueReceive(s_stream.free_queue, &block.index, portMAX_DELAY);
+
+            if (true == s_stream.abort)
+            {
+                block.len = -1;
+            }
+            else
+            {
+                TRACE_SPAN_BEGIN(span);
+                block.len = read(fd, s_stream.buf[block.index], s_stream.block_size);
+                TRACE_SPAN_END(span, "vfs_read", block.len);
+            }
+            xQueueSend(s_stream.full_queue, &block, portMAX_DELAY);
+        } while (block.len > 0);
+    }
+}
+
+/* Stream fd into fp_sink. The reader task keeps up to VFS_STREAM_BUFFERS - 1 blocks
+ * ahead of the sink, so storage and network are busy at the same time. */
+esp_err_t vfs_stream_file (int fd, vfs_stream_sink_t fp_sink, void * p_ctx, 
+                                vfs_stream_stats_t * stats)
+{
+    esp_err_t err_ret = ESP_OK;
+    vfs_stream_block_t block;
+    size_t bytes = 0;
+
+    if (NULL == s_stream.lock)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_stream.lock, portMAX_DELAY);
+    int64_t start_us = esp_timer_get_time();
+    s_stream.abort = false;
+    xQueueSend(s_stream.job_queue, &fd, portMAX_DELAY);
+
+    do
+    {
+        xQueueReceive(s_stream.full_queue, &block, portMAX_DELAY);
+
+        if ((block.len > 0) && (false == s_stream.abort))
+        {
+            err_ret = fp_sink(p_ctx, s_stream.buf[block.index], block.len);
+            bytes += block.len;
+
+            if (ESP_OK != err_ret)
+            {
+                // Let the reader run dry, the remaining blocks are drained below
+                s_stream.abort = true;
+            }
+        }
+        else if ((block.len < 0) && (false == s_stream.abort))
+        {
+            LOG_RING_E(LOG_TAG, "Failed to read file");
+            err_ret = ESP_FAIL;
+        }
+        xQueueSend(s_stream.free_queue, &block.index, portMAX_DELAY);
+    } while (block.len > 0);
+
+    if (NULL != stats)
+    {
+        stats->bytes = bytes;
+        stats->elapsed_us = esp_timer_get_time() - start_us;
+    }
+    xSemaphoreGive(s_stream.lock);
+    return err_ret;
+}
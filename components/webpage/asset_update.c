@@ -0,0 +1,676 @@
+#include "string.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "dirent.h"
+#include "unistd.h"
+#include "fcntl.h"
+#include "errno.h"
+#include "sys/stat.h"
+#include "sys/param.h"
+#include "mbedtls/sha256.h"
+#include "esp_log.h"
+#include "cJSON.h"
+#include "vfs_index.h"
+#include "vfs_storage.h"
+#include "asset_update.h"
+#include "trace.h"
+
+#define LOG_TAG             "[asset_update]"
+#define ASSET_PATH_LEN      (64)
+#define ASSET_MAX_FILES     (64)
+#define ASSET_HASH_LEN      (32)
+#define ASSET_MAX_DEPTH     (4)
+#define ASSET_RECV_RETRIES  (5)
+#define ASSET_FS_PATH_LEN   (WEBPAGE_ROOT_LEN + ASSET_PATH_LEN + 16)
+
+typedef struct
+{
+    char path[ASSET_PATH_LEN];
+    uint8_t hash[ASSET_HASH_LEN];
+    size_t size;
+    bool present;
+} asset_file_t;
+
+/* Release being staged, only touched from the httpd task */
+typedef struct
+{
+    asset_file_t * file;
+    int count;
+    char staging[WEBPAGE_ROOT_LEN];
+    // Slot being served, NULL while the mount point itself is served
+    const char * active_slot;
+    const char * staging_slot;
+} asset_update_obj_t;
+
+// Functions declaration
+static bool asset_hex_decode (const char * hex, uint8_t * out, size_t len);
+static void asset_hex_encode (const uint8_t * data, size_t len, char * out);
+static asset_file_t * asset_find (const char * path);
+static esp_err_t asset_mkdirs (char * path, size_t root_len);
+static void asset_remove_tree (char * path, size_t path_len, int depth);
+static esp_err_t asset_copy (const char * src, const char * dst, char * buf, size_t buf_len, 
+                                uint8_t * hash);
+static int asset_reuse_active (webpage_obj_t * server_context);
+static int asset_reuse_unlisted (webpage_obj_t * server_context, const char * root);
+static esp_err_t asset_write_manifest (void);
+static esp_err_t asset_write_pointer (webpage_obj_t * server_context, const char * slot);
+static void asset_reset (void);
+
+//Variables declaration
+static asset_update_obj_t s_update;
+
+/* Serve the tree named by the pointer file, or the mount point itself before the first update */
+void asset_update_init (webpage_obj_t * server_cred)
+{
+    char path[ASSET_FS_PATH_LEN];
+    char slot[16] = {0};
+    struct stat st;
+
+    memset(&s_update, 0, sizeof(s_update));
+    snprintf(path, sizeof(path), "%s/%s", server_cred->web_mount_point, ASSET_POINTER_FILE);
+    FILE * pointer = fopen(path, "r");
+
+    if (NULL != pointer)
+    {
+        if (NULL != fgets(slot, sizeof(slot), pointer))
+        {
+            slot[strcspn(slot, "\r\n")] = '\0';
+        }
+        fclose(pointer);
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", server_cred->web_mount_point, slot);
+
+    if (((0 == strcmp(slot, ASSET_SLOT_A)) || (0 == strcmp(slot, ASSET_SLOT_B))) && 
+            (0 == stat(path, &st)) && S_ISDIR(st.st_mode))
+    {
+        strlcpy(server_cred->web_roots[0], path, WEBPAGE_ROOT_LEN);
+        s_update.active_slot = (0 == strcmp(slot, ASSET_SLOT_A)) ? ASSET_SLOT_A : ASSET_SLOT_B;
+    }
+    else
+    {
+        strlcpy(server_cred->web_roots[0], server_cred->web_mount_point, WEBPAGE_ROOT_LEN);
+    }
+
+    server_cred->web_roots[1][0] = '\0';
+    server_cred->web_root = server_cred->web_roots[0];
+    server_cred->prev_web_root = NULL;
+    ESP_LOGI(LOG_TAG, "Serving %s", server_cred->web_root);
+}
+
+static bool asset_hex_decode (const char * hex, uint8_t * out, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned int byte;
+
+        if (1 != sscanf(&hex[2 * i], "%2x", &byte))
+        {
+            return false;
+        }
+        out[i] = (uint8_t)byte;
+    }
+
+    return true;
+}
+
+static void asset_hex_encode (const uint8_t * data, size_t len, char * out)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        sprintf(&out[2 * i], "%02x", data[i]);
+    }
+}
+
+static asset_file_t * asset_find (const char * path)
+{
+    for (int i = 0; i < s_update.count; i++)
+    {
+        if (0 == strcmp(s_update.file[i].path, path))
+        {
+            return &s_update.file[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Create the parent directories of path below root */
+static esp_err_t asset_mkdirs (char * path, size_t root_len)
+{
+    esp_err_t err_ret = ESP_OK;
+
+    for (char * p_sep = strchr(path + root_len + 1, '/'); (NULL != p_sep) && (ESP_OK == err_ret); 
+            p_sep = strchr(p_sep + 1, '/'))
+    {
+        *p_sep = '\0';
+
+        if ((0 != mkdir(path, 0775)) && (EEXIST != errno))
+        {
+            ESP_LOGE(LOG_TAG, "Failed to create %s (%d)", path, errno);
+            err_ret = ESP_FAIL;
+        }
+        *p_sep = '/';
+    }
+
+    return err_ret;
+}
+
+static void asset_remove_tree (char * path, size_t path_len, int depth)
+{
+    size_t base_len = strlen(path);
+    DIR * dir = opendir(path);
+    struct dirent * dir_entry;
+    struct stat st;
+
+    if (NULL == dir)
+    {
+        return;
+    }
+
+    while (NULL != (dir_entry = readdir(dir)))
+    {
+        if ((0 == strcmp(dir_entry->d_name, ".")) || (0 == strcmp(dir_entry->d_name, "..")))
+        {
+            continue;
+        }
+
+        snprintf(path + base_len, path_len - base_len, "/%s", dir_entry->d_name);
+
+        if ((0 == stat(path, &st)) && S_ISDIR(st.st_mode) && (depth < ASSET_MAX_DEPTH))
+        {
+            asset_remove_tree(path, path_len, depth + 1);
+        }
+        else
+        {
+            unlink(path);
+        }
+        path[base_len] = '\0';
+    }
+
+    closedir(dir);
+    rmdir(path);
+}
+
+/* Copy src to dst, with hash != NULL the SHA-256 of the copied data is returned too */
+static esp_err_t asset_copy (const char * src, const char * dst, char * buf, size_t buf_len, 
+                                uint8_t * hash)
+{
+    esp_err_t err_ret = ESP_OK;
+    ssize_t read_bytes;
+    mbedtls_sha256_context sha;
+    int src_fd = open(src, O_RDONLY, 0);
+    int dst_fd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+
+    if ((-1 == src_fd) || (-1 == dst_fd))
+    {
+        err_ret = ESP_FAIL;
+    }
+
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+
+    while ((ESP_OK == err_ret) && ((read_bytes = read(src_fd, buf, buf_len)) > 0))
+    {
+        if (write(dst_fd, buf, read_bytes) != read_bytes)
+        {
+            err_ret = ESP_FAIL;
+        }
+        else if (NULL != hash)
+        {
+            mbedtls_sha256_update(&sha, (const unsigned char *)buf, read_bytes);
+        }
+    }
+
+    if (NULL != hash)
+    {
+        mbedtls_sha256_finish(&sha, hash);
+    }
+    mbedtls_sha256_free(&sha);
+
+    if (-1 != src_fd)
+    {
+        close(src_fd);
+    }
+
+    if (-1 != dst_fd)
+    {
+        close(dst_fd);
+    }
+
+    return err_ret;
+}
+
+/* Copy files whose content hash did not change from the served tree into staging,
+ * using the manifest stored with it. Returns the number of reused files. */
+static int asset_reuse_active (webpage_obj_t * server_context)
+{
+    char line[ASSET_HASH_LEN * 2 + ASSET_PATH_LEN + 24];
+    char src[ASSET_FS_PATH_LEN];
+    char dst[ASSET_FS_PATH_LEN];
+    char hex_hash[ASSET_HASH_LEN * 2 + 1];
+    char path[ASSET_PATH_LEN];
+    uint8_t hash[ASSET_HASH_LEN];
+    unsigned long size;
+    int reused = 0;
+    const char * root = webpage_active_root(server_context);
+
+    snprintf(src, sizeof(src), "%s/%s", root, ASSET_MANIFEST_FILE);
+    FILE * manifest = fopen(src, "r");
+
+    if (NULL == manifest)
+    {
+        return asset_reuse_unlisted(server_context, root);
+    }
+
+    while (NULL != fgets(line, sizeof(line), manifest))
+    {
+        if ((3 != sscanf(line, "%64s %lu %63s", hex_hash, &size, path)) || 
+                !asset_hex_decode(hex_hash, hash, sizeof(hash)))
+        {
+            continue;
+        }
+
+        asset_file_t * file = asset_find(path);
+
+        if ((NULL != file) && (false == file->present) && (file->size == size) && 
+                (0 == memcmp(file->hash, hash, sizeof(hash))))
+        {
+            snprintf(src, sizeof(src), "%s%s", root, path);
+            snprintf(dst, sizeof(dst), "%s%s", s_update.staging, path);
+
+            if ((ESP_OK == asset_mkdirs(dst, strlen(s_update.staging))) && 
+                    (ESP_OK == asset_copy(src, dst, server_context->scratch, 
+                                            sizeof(server_context->scratch), NULL)))
+            {
+                file->present = true;
+                reused++;
+            }
+        }
+    }
+
+    fclose(manifest);
+    return reused;
+}
+
+/* The tree flashed with the image (before the first update) has no manifest. Files of
+ * the expected size are hashed while they are copied and kept when the hash matches. */
+static int asset_reuse_unlisted (webpage_obj_t * server_context, const char * root)
+{
+    char src[ASSET_FS_PATH_LEN];
+    char dst[ASSET_FS_PATH_LEN];
+    uint8_t hash[ASSET_HASH_LEN];
+    struct stat st;
+    int reused = 0;
+
+    for (int i = 0; i < s_update.count; i++)
+    {
+        asset_file_t * file = &s_update.file[i];
+        snprintf(src, sizeof(src), "%s%s", root, file->path);
+        snprintf(dst, sizeof(dst), "%s%s", s_update.staging, file->path);
+
+        if ((0 != stat(src, &st)) || !S_ISREG(st.st_mode) || ((size_t)st.st_size != file->size) || 
+                (ESP_OK != asset_mkdirs(dst, strlen(s_update.staging))))
+        {
+            continue;
+        }
+
+        if ((ESP_OK == asset_copy(src, dst, server_context->scratch, sizeof(server_context->scratch), hash)) && 
+                (0 == memcmp(hash, file->hash, sizeof(hash))))
+        {
+            file->present = true;
+            reused++;
+        }
+        else
+        {
+            unlink(dst);
+        }
+    }
+
+    return reused;
+}
+
+static void asset_reset (void)
+{
+    free(s_update.file);
+    s_update.file = NULL;
+    s_update.count = 0;
+    s_update.staging[0] = '\0';
+    s_update.staging_slot = NULL;
+}
+
+/* Accept a manifest {"files":[{"path":"/index.html","sha256":"...","size":123}, ...]},
+ * prepare the inactive slot and answer with the files that still have to be uploaded */
+esp_err_t asset_manifest_post_handler (httpd_req_t * req)
+{
+    webpage_obj_t * server_context = (webpage_obj_t *)req->user_ctx;
+    char * buf = server_context->scratch;
+    char path[ASSET_FS_PATH_LEN];
+    int cur_len = 0;
+    uint64_t release_size = 0;
+    uint64_t free_bytes = 0;
+
+    if (req->content_len >= sizeof(server_context->scratch))
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Manifest too long");
+        return ESP_FAIL;
+    }
+
+    while (cur_len < req->content_len)
+    {
+        int received = httpd_req_recv(req, buf + cur_len, req->content_len - cur_len);
+
+        if (received <= 0)
+        {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to receive manifest");
+            return ESP_FAIL;
+        }
+        cur_len += received;
+    }
+    buf[cur_len] = '\0';
+
+    cJSON * root = cJSON_Parse(buf);
+    cJSON * files = cJSON_GetObjectItem(root, "files");
+    int count = cJSON_GetArraySize(files);
+
+    if (!cJSON_IsArray(files) || (0 == count) || (count > ASSET_MAX_FILES))
+    {
+        cJSON_Delete(root);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid manifest");
+        return ESP_FAIL;
+    }
+
+    asset_reset();
+    s_update.file = calloc(count, sizeof(asset_file_t));
+
+    if (NULL == s_update.file)
+    {
+        cJSON_Delete(root);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    cJSON * item;
+    cJSON_ArrayForEach(item, files)
+    {
+        const char * file_path = cJSON_GetStringValue(cJSON_GetObjectItem(item, "path"));
+        const char * hash = cJSON_GetStringValue(cJSON_GetObjectItem(item, "sha256"));
+        cJSON * size = cJSON_GetObjectItem(item, "size");
+        asset_file_t * file = &s_update.file[s_update.count];
+
+        if ((NULL == file_path) || ('/' != file_path[0]) || vfs_index_is_reserved(file_path) || 
+                (strlen(file_path) >= ASSET_PATH_LEN) || (NULL == hash) || 
+                (ASSET_HASH_LEN * 2 != strlen(hash)) || !cJSON_IsNumber(size) || 
+                (size->valuedouble < 0) || (size->valuedouble > (double)UINT32_MAX) || 
+                (size->valuedouble != (double)(uint32_t)size->valuedouble) || 
+                !asset_hex_decode(hash, file->hash, sizeof(file->hash)))
+        {
+            asset_reset();
+            cJSON_Delete(root);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid manifest entry");
+            return ESP_FAIL;
+        }
+
+        strlcpy(file->path, file_path, sizeof(file->path));
+        file->size = (size_t)size->valuedouble;
+        release_size += file->size;
+        s_update.count++;
+    }
+    cJSON_Delete(root);
+
+    /* Stage into the slot that is not served, it may hold the previous release */
+    const char * slot = ((NULL != s_update.active_slot) && (0 == strcmp(s_update.active_slot, ASSET_SLOT_A))) ? 
+                            ASSET_SLOT_B : ASSET_SLOT_A;
+    s_update.staging_slot = slot;
+    snprintf(s_update.staging, sizeof(s_update.staging), "%s/%s", 
+                server_context->web_mount_point, slot);
+
+    if ((NULL != server_context->prev_web_root) && 
+            (0 == strcmp(server_context->prev_web_root, s_update.staging)))
+    {
+        __atomic_store_n(&server_context->prev_web_root, NULL, __ATOMIC_RELEASE);
+    }
+
+    strlcpy(path, s_update.staging, sizeof(path));
+    asset_remove_tree(path, sizeof(path), 0);
+
+    /* Reused files are copied too, so the whole release has to fit */
+    if ((ESP_OK == vfs_storage_free_bytes(server_context->web_mount_point, &free_bytes)) && 
+            (release_size > free_bytes))
+    {
+        asset_reset();
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Release does not fit the storage");
+        return ESP_FAIL;
+    }
+
+    if ((0 != mkdir(s_update.staging, 0775)) && (EEXIST != errno))
+    {
+        ESP_LOGE(LOG_TAG, "Failed to create %s (%d)", s_update.staging, errno);
+        asset_reset();
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to create staging slot");
+        return ESP_FAIL;
+    }
+    int reused = asset_reuse_active(server_context);
+
+    cJSON * resp = cJSON_CreateObject();
+    cJSON_AddStringToObject(resp, "staging", slot);
+    cJSON_AddNumberToObject(resp, "reused", reused);
+    cJSON * needed = cJSON_AddArrayToObject(resp, "needed");
+
+    for (int i = 0; i < s_update.count; i++)
+    {
+        if (false == s_update.file[i].present)
+        {
+            cJSON_AddItemToArray(needed, cJSON_CreateString(s_update.file[i].path));
+        }
+    }
+
+    TRACE_SPAN_BEGIN(span);
+    const char * json = cJSON_Print(resp);
+    TRACE_SPAN_END(span, "cjson_print", (NULL != json) ? strlen(json) : 0);
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err_ret = httpd_resp_sendstr(req, json);
+    free((void *)json);
+    cJSON_Delete(resp);
+    return err_ret;
+}
+
+/* PUT /api/v1/assets/file?path=/assets/index.js, the body is checked against the manifest hash */
+esp_err_t asset_file_put_handler (httpd_req_t * req)
+{
+    webpage_obj_t * server_context = (webpage_obj_t *)req->user_ctx;
+    char query[ASSET_PATH_LEN + 16];
+    char file_path[ASSET_PATH_LEN];
+    char path[ASSET_FS_PATH_LEN];
+    uint8_t hash[ASSET_HASH_LEN];
+    mbedtls_sha256_context sha;
+    size_t total = 0;
+    int timeouts = 0;
+    bool failed = false;
+
+    if ((ESP_OK != httpd_req_get_url_query_str(req, query, sizeof(query))) || 
+            (ESP_OK != httpd_query_key_value(query, "path", file_path, sizeof(file_path))))
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing path");
+        return ESP_FAIL;
+    }
+
+    asset_file_t * file = asset_find(file_path);
+
+    if ((NULL == file) || (req->content_len != file->size))
+    {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File is not part of the staged manifest");
+        return ESP_FAIL;
+    }
+
+    snprintf(path, sizeof(path), "%s%s", s_update.staging, file->path);
+    int fd = (ESP_OK == asset_mkdirs(path, strlen(s_update.staging))) ? 
+                open(path, O_WRONLY | O_CREAT | O_TRUNC, 0664) : -1;
+
+    if (-1 == fd)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to create file");
+        return ESP_FAIL;
+    }
+
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+
+    while ((false == failed) && (total < file->size))
+    {
+        int received = httpd_req_recv(req, server_context->scratch, 
+                                        MIN(sizeof(server_context->scratch), file->size - total));
+
+        /* Only httpd's single task serves requests, a stalled upload must not hold it */
+        if ((HTTPD_SOCK_ERR_TIMEOUT == received) && (++timeouts < ASSET_RECV_RETRIES))
+        {
+            continue;
+        }
+
+        if ((received <= 0) || (write(fd, server_context->scratch, received) != received))
+        {
+            failed = true;
+        }
+        else
+        {
+            timeouts = 0;
+            mbedtls_sha256_update(&sha, (const unsigned char *)server_context->scratch, received);
+            total += received;
+        }
+    }
+
+    close(fd);
+    mbedtls_sha256_finish(&sha, hash);
+    mbedtls_sha256_free(&sha);
+
+    if (timeouts >= ASSET_RECV_RETRIES)
+    {
+        unlink(path);
+        httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Upload timed out");
+        return ESP_FAIL;
+    }
+
+    if (failed || (0 != memcmp(hash, file->hash, sizeof(hash))))
+    {
+        unlink(path);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Upload failed or hash mismatch");
+        return ESP_FAIL;
+    }
+
+    file->present = true;
+    return httpd_resp_sendstr(req, "OK");
+}
+
+static esp_err_t asset_write_manifest (void)
+{
+    char path[ASSET_FS_PATH_LEN];
+    char hex_hash[ASSET_HASH_LEN * 2 + 1];
+
+    snprintf(path, sizeof(path), "%s/%s", s_update.staging, ASSET_MANIFEST_FILE);
+    FILE * manifest = fopen(path, "w");
+
+    if (NULL == manifest)
+    {
+        return ESP_FAIL;
+    }
+
+    for (int i = 0; i < s_update.count; i++)
+    {
+        asset_hex_encode(s_update.file[i].hash, ASSET_HASH_LEN, hex_hash);
+        fprintf(manifest, "%s %lu %s\n", hex_hash, (unsigned long)s_update.file[i].size, 
+                    s_update.file[i].path);
+    }
+
+    return (0 == fclose(manifest)) ? ESP_OK : ESP_FAIL;
+}
+
+/* Persist the active slot, rename replaces the pointer in one step on LittleFS.
+ * FAT refuses to rename onto an existing file, so it is removed first there. */
+static esp_err_t asset_write_pointer (webpage_obj_t * server_context, const char * slot)
+{
+    char tmp_path[ASSET_FS_PATH_LEN];
+    char path[ASSET_FS_PATH_LEN];
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s/%s.tmp", server_context->web_mount_point, ASSET_POINTER_FILE);
+    snprintf(path, sizeof(path), "%s/%s", server_context->web_mount_point, ASSET_POINTER_FILE);
+    FILE * pointer = fopen(tmp_path, "w");
+
+    if (NULL == pointer)
+    {
+        return ESP_FAIL;
+    }
+
+    fprintf(pointer, "%s\n", slot);
+
+    if (0 != fclose(pointer))
+    {
+        return ESP_FAIL;
+    }
+
+    if ((0 != rename(tmp_path, path)) && ((0 != unlink(path)) || (0 != rename(tmp_path, path))))
+    {
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/* Switch the served tree to the staged release once every file is present */
+esp_err_t asset_commit_post_handler (httpd_req_t * req)
+{
+    webpage_obj_t * server_context = (webpage_obj_t *)req->user_ctx;
+
+    if (0 == s_update.count)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No staged release");
+        return ESP_FAIL;
+    }
+
+    for (int i = 0; i < s_update.count; i++)
+    {
+        if (false == s_update.file[i].present)
+        {
+            httpd_resp_set_status(req, "409 Conflict");
+            return httpd_resp_sendstr(req, "Staged release is incomplete");
+        }
+    }
+
+    if (true == vfs_index_running())
+    {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_sendstr(req, "Asset index is being built");
+    }
+
+    const char * slot = s_update.staging_slot;
+
+    if ((ESP_OK != asset_write_manifest()) || (ESP_OK != asset_write_pointer(server_context, slot)))
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to commit release");
+        return ESP_FAIL;
+    }
+
+    /* Requests that already resolved the old root finish on it, new requests use the
+     * staged tree. The old tree stays readable until the next manifest reuses its slot. */
+    const char * old_root = webpage_active_root(server_context);
+    char * new_root = (old_root == server_context->web_roots[0]) ? 
+                            server_context->web_roots[1] : server_context->web_roots[0];
+    __atomic_store_n(&server_context->prev_web_root, NULL, __ATOMIC_RELEASE);
+    strlcpy(new_root, s_update.staging, WEBPAGE_ROOT_LEN);
+    __atomic_store_n(&server_context->web_root, new_root, __ATOMIC_RELEASE);
+    __atomic_store_n(&server_context->prev_web_root, old_root, __ATOMIC_RELEASE);
+
+    s_update.active_slot = slot;
+
+    /* Safe to rebuild the index now: this handler runs on the only httpd task, so no
+     * response that still uses an index entry or its preloaded data is in flight,
+     * and vfs_index_running() was checked above. The cached system info is dropped
+     * once the new warm-up numbers are in. */
+    if (ESP_OK != vfs_index_start(new_root, warmup_done_cb, server_context))
+    {
+        ESP_LOGE(LOG_TAG, "Failed to index %s, serving without the index", new_root);
+    }
+    ESP_LOGI(LOG_TAG, "Serving %s (%d files)", new_root, s_update.count);
+    asset_reset();
+    return httpd_resp_sendstr(req, "OK");
+}
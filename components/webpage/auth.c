@@ -0,0 +1,299 @@
+#include "string.h"
+#include "stdio.h"
+#include "nvs.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_tls_crypto.h"
+#include "esp_log.h"
+#include "auth.h"
+
+#define LOG_TAG             "[auth]"
+#define AUTH_NVS_NAMESPACE  "web_auth"
+#define AUTH_COOKIE_NAME    "session"
+#if CONFIG_WEB_HTTPS_ENABLE
+#define AUTH_COOKIE_ATTR    "; Path=/; HttpOnly; Secure"
+#else
+#define AUTH_COOKIE_ATTR    "; Path=/; HttpOnly"
+#endif
+/* Set with the 401 challenge. A client that sends it back keeps cookies and gets a session */
+#define AUTH_PROBE_COOKIE   AUTH_COOKIE_NAME "=0" AUTH_COOKIE_ATTR "; Max-Age=300"
+
+#if CONFIG_WEB_AUTH_ENABLE
+// Functions declaration
+static esp_err_t auth_load_credentials (char * username, size_t username_len, 
+                                    char * password, size_t password_len);
+static bool auth_ct_equal (const void * a, const void * b, size_t len);
+static void auth_mac (auth_t * auth, const uint8_t * id, uint8_t * mac);
+static void auth_hex_encode (const uint8_t * data, size_t len, char * out);
+static bool auth_hex_decode (const char * hex, uint8_t * out, size_t len);
+static bool auth_check_cookie (auth_t * auth, httpd_req_t * req, bool * has_cookie);
+static void auth_new_session (auth_t * auth, httpd_req_t * req);
+#endif
+
+/* Build the expected Authorization header and the session HMAC key once at startup */
+esp_err_t auth_init (auth_t * auth)
+{
+    memset(auth, 0, sizeof(auth_t));
+
+    #if CONFIG_WEB_AUTH_ENABLE
+    char password[64] = {0};
+    char user_info[sizeof(auth->username) + sizeof(password) + 1];
+    size_t out = 0;
+
+    if (ESP_OK != auth_load_credentials(auth->username, sizeof(auth->username), 
+                                        password, sizeof(password)))
+    {
+        return ESP_FAIL;
+    }
+    int len = snprintf(user_info, sizeof(user_info), "%s:%s", auth->username, password);
+    strcpy(auth->expected, "Basic ");
+
+    if (0 != esp_crypto_base64_encode((unsigned char *)auth->expected + 6, 
+                                        sizeof(auth->expected) - 6 - 1, &out, 
+                                        (const unsigned char *)user_info, len))
+    {
+        ESP_LOGE(LOG_TAG, "Credentials too long");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    auth->expected_len = 6 + out;
+    auth->expected[auth->expected_len] = '\0';
+    memset(password, 0, sizeof(password));
+    memset(user_info, 0, sizeof(user_info));
+
+    esp_fill_random(auth->hmac_key, sizeof(auth->hmac_key));
+    mbedtls_md_init(&auth->hmac_ctx);
+
+    if ((0 != mbedtls_md_setup(&auth->hmac_ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1)) ||
+            (0 != mbedtls_md_hmac_starts(&auth->hmac_ctx, auth->hmac_key, sizeof(auth->hmac_key))))
+    {
+        ESP_LOGE(LOG_TAG, "Failed to set up session HMAC");
+        return ESP_FAIL;
+    }
+    auth->enabled = true;
+    #endif
+
+    return ESP_OK;
+}
+
+#if CONFIG_WEB_AUTH_ENABLE
+/* Credentials are provisioned in NVS, the Kconfig fallback is only used when none
+ * were provisioned. Any other error (e.g. a value too long) or an empty username or
+ * password fails closed. */
+static esp_err_t auth_load_credentials (char * username, size_t username_len, 
+                                    char * password, size_t password_len)
+{
+    nvs_handle_t nvs;
+    esp_err_t err_ret = nvs_open(AUTH_NVS_NAMESPACE, NVS_READONLY, &nvs);
+
+    if (ESP_OK == err_ret)
+    {
+        err_ret = nvs_get_str(nvs, "user", username, &username_len);
+
+        if (ESP_OK == err_ret)
+        {
+            err_ret = nvs_get_str(nvs, "pass", password, &password_len);
+        }
+        nvs_close(nvs);
+    }
+
+    if (ESP_ERR_NVS_NOT_FOUND == err_ret)
+    {
+        ESP_LOGW(LOG_TAG, "No credentials in NVS namespace \"%s\", using the fallback", AUTH_NVS_NAMESPACE);
+        strlcpy(username, CONFIG_WEB_AUTH_DEFAULT_USERNAME, username_len);
+        strlcpy(password, CONFIG_WEB_AUTH_DEFAULT_PASSWORD, password_len);
+        err_ret = ESP_OK;
+    }
+    else if (ESP_OK != err_ret)
+    {
+        ESP_LOGE(LOG_TAG, "Failed to read credentials from NVS (%s)", esp_err_to_name(err_ret));
+    }
+
+    if ((ESP_OK == err_ret) && (('\0' == username[0]) || ('\0' == password[0])))
+    {
+        ESP_LOGE(LOG_TAG, "Empty credentials, provision them in NVS namespace \"%s\"", AUTH_NVS_NAMESPACE);
+        err_ret = ESP_ERR_INVALID_ARG;
+    }
+
+    if (ESP_OK != err_ret)
+    {
+        memset(password, 0, password_len);
+    }
+
+    return err_ret;
+}
+
+static bool auth_ct_equal (const void * a, const void * b, size_t len)
+{
+    const uint8_t * p_a = (const uint8_t *)a;
+    const uint8_t * p_b = (const uint8_t *)b;
+    uint8_t diff = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        diff |= p_a[i] ^ p_b[i];
+    }
+
+    return (0 == diff);
+}
+
+static void auth_mac (auth_t * auth, const uint8_t * id, uint8_t * mac)
+{
+    mbedtls_md_hmac_reset(&auth->hmac_ctx);
+    mbedtls_md_hmac_update(&auth->hmac_ctx, id, AUTH_TOKEN_ID_LEN);
+    mbedtls_md_hmac_finish(&auth->hmac_ctx, mac);
+}
+
+static void auth_hex_encode (const uint8_t * data, size_t len, char * out)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < len; i++)
+    {
+        out[2 * i] = hex[data[i] >> 4];
+        out[2 * i + 1] = hex[data[i] & 0x0F];
+    }
+}
+
+static bool auth_hex_decode (const char * hex, uint8_t * out, size_t len)
+{
+    for (size_t i = 0; i < 2 * len; i++)
+    {
+        char c = hex[i];
+        uint8_t nibble;
+
+        if ((c >= '0') && (c <= '9'))
+        {
+            nibble = c - '0';
+        }
+        else if ((c >= 'a') && (c <= 'f'))
+        {
+            nibble = c - 'a' + 10;
+        }
+        else
+        {
+            return false;
+        }
+        out[i / 2] = (i & 1) ? (out[i / 2] | nibble) : (nibble << 4);
+    }
+
+    return true;
+}
+
+/* A valid cookie skips the Basic header entirely. has_cookie is set when the client
+ * sent the session cookie at all, even a stale one. */
+static bool auth_check_cookie (auth_t * auth, httpd_req_t * req, bool * has_cookie)
+{
+    char token[AUTH_TOKEN_LEN + 1];
+    size_t token_len = sizeof(token);
+    uint8_t id[AUTH_TOKEN_ID_LEN];
+    uint8_t mac[AUTH_TOKEN_MAC_LEN];
+    uint8_t expected_mac[32];
+    int64_t now_us = esp_timer_get_time();
+    bool valid = false;
+    esp_err_t err_ret = httpd_req_get_cookie_val(req, AUTH_COOKIE_NAME, token, &token_len);
+
+    *has_cookie = (ESP_OK == err_ret) || (ESP_ERR_HTTPD_RESULT_TRUNC == err_ret);
+
+    if ((ESP_OK != err_ret) || 
+            (AUTH_TOKEN_LEN != strlen(token)) || ('.' != token[AUTH_TOKEN_ID_LEN * 2]) || 
+            !auth_hex_decode(token, id, sizeof(id)) || 
+            !auth_hex_decode(&token[AUTH_TOKEN_ID_LEN * 2 + 1], mac, sizeof(mac)))
+    {
+        return false;
+    }
+
+    auth_mac(auth, id, expected_mac);
+
+    if (!auth_ct_equal(mac, expected_mac, sizeof(mac)))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < AUTH_SESSIONS; i++)
+    {
+        if ((auth->session[i].expire_us > now_us) && 
+                auth_ct_equal(auth->session[i].id, id, AUTH_TOKEN_ID_LEN))
+        {
+            valid = true;
+        }
+    }
+
+    return valid;
+}
+
+/* Hand a token to the client in an expired slot. Live sessions are never evicted,
+ * with a full table the client keeps authenticating with Basic credentials. */
+static void auth_new_session (auth_t * auth, httpd_req_t * req)
+{
+    auth_session_t * session = NULL;
+    int64_t now_us = esp_timer_get_time();
+    uint8_t mac[32];
+    char token[AUTH_TOKEN_LEN + 1];
+
+    for (int i = 0; (i < AUTH_SESSIONS) && (NULL == session); i++)
+    {
+        if (auth->session[i].expire_us <= now_us)
+        {
+            session = &auth->session[i];
+        }
+    }
+
+    if (NULL == session)
+    {
+        return;
+    }
+
+    esp_fill_random(session->id, sizeof(session->id));
+    session->expire_us = now_us + (int64_t)CONFIG_WEB_AUTH_SESSION_TTL_S * 1000000;
+    auth_mac(auth, session->id, mac);
+    auth_hex_encode(session->id, AUTH_TOKEN_ID_LEN, token);
+    token[AUTH_TOKEN_ID_LEN * 2] = '.';
+    auth_hex_encode(mac, AUTH_TOKEN_MAC_LEN, &token[AUTH_TOKEN_ID_LEN * 2 + 1]);
+    token[AUTH_TOKEN_LEN] = '\0';
+
+    snprintf(auth->set_cookie, sizeof(auth->set_cookie), "%s=%s" AUTH_COOKIE_ATTR "; Max-Age=%d", 
+                AUTH_COOKIE_NAME, token, CONFIG_WEB_AUTH_SESSION_TTL_S);
+    httpd_resp_set_hdr(req, "Set-Cookie", auth->set_cookie);
+}
+#endif
+
+/* Returns ESP_OK when the request is authenticated, otherwise 401 has been sent.
+ * Only fixed size buffers are used, nothing is allocated per request. */
+esp_err_t auth_check (auth_t * auth, httpd_req_t * req)
+{
+    #if CONFIG_WEB_AUTH_ENABLE
+    char header[AUTH_HEADER_LEN];
+    bool has_cookie = false;
+
+    if (false == auth->enabled)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Authentication unavailable");
+        return ESP_FAIL;
+    }
+
+    if (auth_check_cookie(auth, req, &has_cookie))
+    {
+        return ESP_OK;
+    }
+
+    if ((ESP_OK == httpd_req_get_hdr_value_str(req, "Authorization", header, sizeof(header))) && 
+            (auth->expected_len == strlen(header)) && 
+            auth_ct_equal(header, auth->expected, auth->expected_len))
+    {
+        /* Clients that never send the cookie back (curl, scripts) would only fill the table */
+        if (true == has_cookie)
+        {
+            auth_new_session(auth, req);
+        }
+        return ESP_OK;
+    }
+
+    httpd_resp_set_status(req, "401 Unauthorized");
+    httpd_resp_set_hdr(req, "Set-Cookie", AUTH_PROBE_COOKIE);
+    httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"" CONFIG_WEB_AUTH_REALM "\"");
+    httpd_resp_send(req, NULL, 0);
+    return ESP_FAIL;
+    #else
+    return ESP_OK;
+    #endif
+}
@@ -0,0 +1,17 @@
+#ifndef __ASSET_UPDATE_H__
+#define __ASSET_UPDATE_H__
+
+#include "webpage.h"
+#include "vfs_index.h"
+
+#define ASSET_POINTER_FILE      ".active"
+#define ASSET_MANIFEST_FILE     ".manifest"
+#define ASSET_SLOT_A            VFS_INDEX_SLOT_A
+#define ASSET_SLOT_B            VFS_INDEX_SLOT_B
+
+//Functions
+void asset_update_init (webpage_obj_t * server_cred);
+esp_err_t asset_manifest_post_handler (httpd_req_t * req);
+esp_err_t asset_file_put_handler (httpd_req_t * req);
+esp_err_t asset_commit_post_handler (httpd_req_t * req);
+#endif
@@ -0,0 +1,42 @@
+#ifndef __AUTH_H__
+#define __AUTH_H__
+
+#include "sdkconfig.h"
+#include "esp_http_server.h"
+#include "mbedtls/md.h"
+
+#define AUTH_HEADER_LEN         (128)
+#define AUTH_TOKEN_ID_LEN       (8)
+#define AUTH_TOKEN_MAC_LEN      (16)
+/* hex(id) "." hex(truncated HMAC-SHA256(id)) */
+#define AUTH_TOKEN_LEN          (AUTH_TOKEN_ID_LEN * 2 + 1 + AUTH_TOKEN_MAC_LEN * 2)
+#if CONFIG_WEB_AUTH_ENABLE
+#define AUTH_SESSIONS           CONFIG_WEB_AUTH_SESSIONS
+#else
+#define AUTH_SESSIONS           1
+#endif
+
+typedef struct
+{
+    uint8_t id[AUTH_TOKEN_ID_LEN];
+    int64_t expire_us;
+} auth_session_t;
+
+typedef struct
+{
+    bool enabled;
+    char username[32];
+    // "Basic " + base64(username:password), computed once
+    char expected[AUTH_HEADER_LEN];
+    size_t expected_len;
+    uint8_t hmac_key[32];
+    mbedtls_md_context_t hmac_ctx;
+    auth_session_t session[AUTH_SESSIONS];
+    // Set-Cookie value must outlive httpd_resp_set_hdr until the response is sent
+    char set_cookie[AUTH_TOKEN_LEN + 64];
+} auth_t;
+
+//Functions
+esp_err_t auth_init (auth_t * auth);
+esp_err_t auth_check (auth_t * auth, httpd_req_t * req);
+#endif
@@ -0,0 +1,40 @@
+#ifndef __RATE_LIMIT_H__
+#define __RATE_LIMIT_H__
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_http_server.h"
+
+#if CONFIG_WEB_RATE_LIMIT_ENABLE
+#define RATE_LIMIT_CLIENTS      CONFIG_WEB_RATE_LIMIT_CLIENTS
+#else
+#define RATE_LIMIT_CLIENTS      1
+#endif
+
+typedef enum
+{
+    ROUTE_CLASS_API = 0,
+    ROUTE_CLASS_STATIC,
+    ROUTE_CLASS_MAX
+} route_class_t;
+
+typedef struct
+{
+    uint32_t client_key;
+    int64_t last_us;
+    // Tokens scaled by 1000 so refills between requests are not lost
+    int32_t milli_tokens[ROUTE_CLASS_MAX];
+} rate_limit_client_t;
+
+typedef struct
+{
+    portMUX_TYPE lock;
+    uint32_t limited;
+    uint32_t shed;
+    rate_limit_client_t client[RATE_LIMIT_CLIENTS];
+} rate_limit_t;
+
+//Functions
+void rate_limit_init (rate_limit_t * limiter);
+esp_err_t rate_limit_check (rate_limit_t * limiter, httpd_req_t * req, route_class_t route_class);
+#endif
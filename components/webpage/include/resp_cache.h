@@ -0,0 +1,40 @@
+#ifndef __RESP_CACHE_H__
+#define __RESP_CACHE_H__
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_http_server.h"
+
+#if CONFIG_WEB_RESP_CACHE_ENABLE
+#define RESP_CACHE_ENTRIES      CONFIG_WEB_RESP_CACHE_ENTRIES
+#define RESP_CACHE_SLOT_SIZE    CONFIG_WEB_RESP_CACHE_SLOT_SIZE
+#else
+#define RESP_CACHE_ENTRIES      1
+#define RESP_CACHE_SLOT_SIZE    1
+#endif
+
+typedef struct
+{
+    const char * uri;
+    const char * content_type;
+    int64_t expire_us;
+    size_t len;
+    uint32_t hits;
+} resp_cache_entry_t;
+
+typedef struct
+{
+    SemaphoreHandle_t lock;
+    bool overflow_logged;
+    resp_cache_entry_t entry[RESP_CACHE_ENTRIES];
+    // Pre-serialized bodies, one slot per entry
+    char arena[RESP_CACHE_ENTRIES][RESP_CACHE_SLOT_SIZE];
+} resp_cache_t;
+
+//Functions
+void resp_cache_init (resp_cache_t * cache);
+esp_err_t resp_cache_send (resp_cache_t * cache, httpd_req_t * req, char * buf, size_t buf_len);
+void resp_cache_store (resp_cache_t * cache, const char * uri, const char * content_type,
+                            const char * data, size_t len, uint32_t ttl_ms);
+void resp_cache_invalidate (resp_cache_t * cache, const char * uri);
+#endif
@@ -2,18 +2,53 @@
 #define __WEBPAGE_H__
 
 #include "esp_http_server.h"
+#include "resp_cache.h"
+#include "rate_limit.h"
+#include "auth.h"
 
 #define SCRATCH_BUFSIZE (10240)
+#define WEBPAGE_MAX_ROUTES  (16)
+#define WEBPAGE_ROOT_LEN    (48)
+
+typedef struct
+{
+    int red;
+    int green;
+    int blue;
+} light_obj_t;
+
+typedef esp_err_t (*http_uri_handler)(httpd_req_t *req);
+
+/* A registered route, httpd calls webpage_dispatch which applies the
+ * request checks before handing req to fp_handler with p_user_ctx */
+typedef struct
+{
+    http_uri_handler fp_handler;
+    void * p_user_ctx;
+    route_class_t route_class;
+    void * p_server;
+} webpage_route_t;
 
 typedef struct
 {
     char web_mount_point[32];
+    /* Served tree: web_root points into web_roots and is swapped atomically when
+     * an asset update is committed, prev_web_root still serves stale asset URLs */
+    char web_roots[2][WEBPAGE_ROOT_LEN];
+    const char * web_root;
+    const char * prev_web_root;
     char scratch[SCRATCH_BUFSIZE];
+    light_obj_t light;
+    resp_cache_t resp_cache;
+    rate_limit_t rate_limit;
+    auth_t auth;
+    int route_count;
+    webpage_route_t routes[WEBPAGE_MAX_ROUTES];
 } webpage_obj_t;
 
-typedef esp_err_t (*http_uri_handler)(httpd_req_t *req);
-
 void webpage_init(webpage_obj_t *);
+const char * webpage_active_root(webpage_obj_t *);
+void warmup_done_cb(void * p_ctx);
 httpd_uri_t webpage_handler(const char *p_uri, httpd_method_t e_method,
                             http_uri_handler fp_handler, void *p_user_ctx);
 #endif
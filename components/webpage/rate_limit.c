@@ -0,0 +1,165 @@
+#include "string.h"
+#include "sys/param.h"
+#include "lwip/sockets.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "rate_limit.h"
+
+#define LOG_TAG     "[rate_limit]"
+
+#if CONFIG_WEB_RATE_LIMIT_ENABLE
+// Refill rate and bucket depth per route class
+static const int32_t s_rate_per_sec[ROUTE_CLASS_MAX] = 
+{
+    CONFIG_WEB_RATE_LIMIT_API_PER_SEC,
+    CONFIG_WEB_RATE_LIMIT_STATIC_PER_SEC
+};
+static const int32_t s_burst[ROUTE_CLASS_MAX] = 
+{
+    CONFIG_WEB_RATE_LIMIT_API_BURST,
+    CONFIG_WEB_RATE_LIMIT_STATIC_BURST
+};
+
+// Functions declaration
+static uint32_t rate_limit_client_key (httpd_req_t * req);
+static bool rate_limit_overloaded (httpd_req_t * req);
+static bool rate_limit_take (rate_limit_t * limiter, uint32_t client_key, route_class_t route_class);
+#endif
+
+void rate_limit_init (rate_limit_t * limiter)
+{
+    portMUX_INITIALIZE(&limiter->lock);
+    limiter->limited = 0;
+    limiter->shed = 0;
+    memset(limiter->client, 0, sizeof(limiter->client));
+}
+
+#if CONFIG_WEB_RATE_LIMIT_ENABLE
+/* Hash the peer address, IPv4 peers show up as IPv4 mapped IPv6 addresses */
+static uint32_t rate_limit_client_key (httpd_req_t * req)
+{
+    struct sockaddr_in6 addr;
+    socklen_t addr_len = sizeof(addr);
+    uint32_t hash = 2166136261u;
+
+    if (0 != getpeername(httpd_req_to_sockfd(req), (struct sockaddr *)&addr, &addr_len))
+    {
+        return 0;
+    }
+
+    const uint8_t * bytes = (addr.sin6_family == AF_INET) ? 
+                                (const uint8_t *)&((struct sockaddr_in *)&addr)->sin_addr : 
+                                (const uint8_t *)&addr.sin6_addr;
+    size_t len = (addr.sin6_family == AF_INET) ? 4 : 16;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/* Shed load when the heap is low or almost all sockets are taken */
+static bool rate_limit_overloaded (httpd_req_t * req)
+{
+    if (esp_get_free_heap_size() < CONFIG_WEB_SHED_MIN_FREE_HEAP)
+    {
+        return true;
+    }
+
+    #if CONFIG_WEB_SHED_MAX_OPEN_SOCKETS > 0
+    int client_fds[CONFIG_LWIP_MAX_SOCKETS];
+    size_t fds = CONFIG_LWIP_MAX_SOCKETS;
+
+    if ((ESP_OK == httpd_get_client_list(req->handle, &fds, client_fds)) && 
+            (fds >= CONFIG_WEB_SHED_MAX_OPEN_SOCKETS))
+    {
+        return true;
+    }
+    #endif
+
+    return false;
+}
+
+static bool rate_limit_take (rate_limit_t * limiter, uint32_t client_key, route_class_t route_class)
+{
+    int64_t now_us = esp_timer_get_time();
+    rate_limit_client_t * client = NULL;
+    rate_limit_client_t * oldest = &limiter->client[0];
+    bool allowed = false;
+
+    taskENTER_CRITICAL(&limiter->lock);
+
+    for (int i = 0; i < RATE_LIMIT_CLIENTS; i++)
+    {
+        if ((0 != limiter->client[i].last_us) && (client_key == limiter->client[i].client_key))
+        {
+            client = &limiter->client[i];
+            break;
+        }
+        else if (limiter->client[i].last_us < oldest->last_us)
+        {
+            oldest = &limiter->client[i];
+        }
+    }
+
+    if (NULL == client)
+    {
+        // Unknown client, recycle the least recently seen slot with full buckets
+        client = oldest;
+        client->client_key = client_key;
+        client->last_us = now_us;
+
+        for (int i = 0; i < ROUTE_CLASS_MAX; i++)
+        {
+            client->milli_tokens[i] = s_burst[i] * 1000;
+        }
+    }
+
+    for (int i = 0; i < ROUTE_CLASS_MAX; i++)
+    {
+        int64_t refill = ((now_us - client->last_us) * s_rate_per_sec[i]) / 1000;
+        client->milli_tokens[i] = (int32_t)MIN(client->milli_tokens[i] + refill, 
+                                                (int64_t)s_burst[i] * 1000);
+    }
+    client->last_us = now_us;
+
+    if (client->milli_tokens[route_class] >= 1000)
+    {
+        client->milli_tokens[route_class] -= 1000;
+        allowed = true;
+    }
+    taskEXIT_CRITICAL(&limiter->lock);
+
+    return allowed;
+}
+#endif
+
+/* Returns ESP_OK when the request may be dispatched, otherwise the response has
+ * already been sent: ESP_ERR_NO_MEM for 503 (load shed), ESP_FAIL for 429 */
+esp_err_t rate_limit_check (rate_limit_t * limiter, httpd_req_t * req, route_class_t route_class)
+{
+    #if CONFIG_WEB_RATE_LIMIT_ENABLE
+    if (true == rate_limit_overloaded(req))
+    {
+        limiter->shed++;
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (false == rate_limit_take(limiter, rate_limit_client_key(req), route_class))
+    {
+        limiter->limited++;
+        httpd_resp_set_status(req, "429 Too Many Requests");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_FAIL;
+    }
+    #endif
+
+    return ESP_OK;
+}
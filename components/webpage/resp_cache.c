@@ -0,0 +1,149 @@
+#include "string.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "resp_cache.h"
+
+#define LOG_TAG     "[resp_cache]"
+
+// Functions declaration
+static resp_cache_entry_t * resp_cache_find (resp_cache_t * cache, const char * uri, size_t uri_len);
+
+void resp_cache_init (resp_cache_t * cache)
+{
+    memset(cache->entry, 0, sizeof(cache->entry));
+    cache->overflow_logged = false;
+    cache->lock = xSemaphoreCreateMutex();
+
+    if (NULL == cache->lock)
+    {
+        ESP_LOGE(LOG_TAG, "Failed to create cache lock");
+    }
+}
+
+/* Match on the path only, a query string does not change idempotent responses */
+static resp_cache_entry_t * resp_cache_find (resp_cache_t * cache, const char * uri, size_t uri_len)
+{
+    for (int i = 0; i < RESP_CACHE_ENTRIES; i++)
+    {
+        resp_cache_entry_t * entry = &cache->entry[i];
+
+        if ((NULL != entry->uri) && (strlen(entry->uri) == uri_len) &&
+                (0 == strncmp(entry->uri, uri, uri_len)))
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/* Replay a cached response, copied into buf so the lock is not held while sending.
+ * Returns ESP_ERR_NOT_FOUND on a miss or an expired entry. */
+esp_err_t resp_cache_send (resp_cache_t * cache, httpd_req_t * req, char * buf, size_t buf_len)
+{
+    #if CONFIG_WEB_RESP_CACHE_ENABLE
+    const char * content_type = NULL;
+    size_t len = 0;
+
+    if ((NULL == cache->lock) || (pdTRUE != xSemaphoreTake(cache->lock, portMAX_DELAY)))
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    resp_cache_entry_t * entry = resp_cache_find(cache, req->uri, strcspn(req->uri, "?"));
+
+    if ((NULL != entry) && (esp_timer_get_time() < entry->expire_us) && (entry->len <= buf_len))
+    {
+        int slot = entry - cache->entry;
+        memcpy(buf, cache->arena[slot], entry->len);
+        content_type = entry->content_type;
+        len = entry->len;
+        entry->hits++;
+    }
+    xSemaphoreGive(cache->lock);
+
+    if (NULL == content_type)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    httpd_resp_set_type(req, content_type);
+    return httpd_resp_send(req, buf, len);
+    #else
+    return ESP_ERR_NOT_FOUND;
+    #endif
+}
+
+/* Store a serialized response under uri, which must be a string with static lifetime */
+void resp_cache_store (resp_cache_t * cache, const char * uri, const char * content_type,
+                            const char * data, size_t len, uint32_t ttl_ms)
+{
+    #if CONFIG_WEB_RESP_CACHE_ENABLE
+    if (NULL == cache->lock)
+    {
+        return;
+    }
+
+    if (len > RESP_CACHE_SLOT_SIZE)
+    {
+        if (false == cache->overflow_logged)
+        {
+            cache->overflow_logged = true;
+            ESP_LOGW(LOG_TAG, "%s is %u bytes, larger than a cache slot (%d), not cached", 
+                        uri, (unsigned int)len, RESP_CACHE_SLOT_SIZE);
+        }
+        return;
+    }
+
+    xSemaphoreTake(cache->lock, portMAX_DELAY);
+    resp_cache_entry_t * entry = resp_cache_find(cache, uri, strlen(uri));
+
+    if (NULL == entry)
+    {
+        // Reuse a free slot, otherwise evict the entry closest to expiry
+        entry = &cache->entry[0];
+
+        for (int i = 0; i < RESP_CACHE_ENTRIES; i++)
+        {
+            if (NULL == cache->entry[i].uri)
+            {
+                entry = &cache->entry[i];
+                break;
+            }
+            else if (cache->entry[i].expire_us < entry->expire_us)
+            {
+                entry = &cache->entry[i];
+            }
+        }
+        entry->hits = 0;
+    }
+
+    int slot = entry - cache->entry;
+    memcpy(cache->arena[slot], data, len);
+    entry->uri = uri;
+    entry->content_type = content_type;
+    entry->len = len;
+    entry->expire_us = esp_timer_get_time() + (int64_t)ttl_ms * 1000;
+    xSemaphoreGive(cache->lock);
+    #endif
+}
+
+/* Drop the entry of uri, called when the state behind it changes */
+void resp_cache_invalidate (resp_cache_t * cache, const char * uri)
+{
+    #if CONFIG_WEB_RESP_CACHE_ENABLE
+    if (NULL == cache->lock)
+    {
+        return;
+    }
+
+    xSemaphoreTake(cache->lock, portMAX_DELAY);
+    resp_cache_entry_t * entry = resp_cache_find(cache, uri, strlen(uri));
+
+    if (NULL != entry)
+    {
+        entry->expire_us = 0;
+    }
+    xSemaphoreGive(cache->lock);
+    #endif
+}
@@ -1,7 +1,18 @@
-#include "esp_tls_crypto.h"
 #include "esp_chip_info.h"
+#if CONFIG_WEB_HTTPS_ENABLE
+#include "esp_https_server.h"
+#endif
 #include "esp_random.h"
+#include "esp_system.h"
 #include "vfs_storage.h"
+#include "vfs_stream.h"
+#include "vfs_index.h"
+#include "ota_update.h"
+#include "log_ring.h"
+#include "trace.h"
+#include "network.h"
+#include "auth.h"
+#include "asset_update.h"
 #include "esp_vfs.h"
 #include "webpage.h"
 #include "esp_log.h"
@@ -9,65 +20,169 @@
 #include "cJSON.h"
 
 #define LOG_TAG		    "[webpage app]"
-#define ENABLE_AUTH     0 
+#define URI_SYSTEM_INFO     "/api/v1/system/info"
+#define URI_TEMP_RAW        "/api/v1/temp/raw"
+#define URI_LIGHT           "/api/v1/light/brightness"
+#define URI_OTA             "/api/v1/ota"
+#define URI_LOGS            "/api/v1/logs"
+#define URI_TRACE           "/api/v1/trace"
+#define URI_ASSET_MANIFEST  "/api/v1/assets/manifest"
+#define URI_ASSET_FILE      "/api/v1/assets/file"
+#define URI_ASSET_COMMIT    "/api/v1/assets/commit"
+#if CONFIG_WEB_RESP_CACHE_ENABLE
+#define SYSINFO_TTL_MS      CONFIG_WEB_RESP_CACHE_SYSINFO_TTL_MS
+#define TEMP_TTL_MS         CONFIG_WEB_RESP_CACHE_TEMP_TTL_MS
+#define LIGHT_TTL_MS        CONFIG_WEB_RESP_CACHE_LIGHT_TTL_MS
+#else
+#define SYSINFO_TTL_MS      0
+#define TEMP_TTL_MS         0
+#define LIGHT_TTL_MS        0
+#endif
 #define CHECK_FILE_EXTENSION(filename, ext) (strcasecmp(&filename[strlen(filename) - strlen(ext)], \
                                                 ext) == 0)
 
 // Variables
 
-#if ENABLE_AUTH
-typedef struct 
-{
-    char * username;
-    char * password;
-} basic_auth_info_t;
-#endif
 
 //Functions
 esp_err_t stop_webserver(httpd_handle_t server);
-esp_err_t basic_auth_get_handler(httpd_req_t * req);
 esp_err_t system_info_get_handler(httpd_req_t * req);
 esp_err_t rest_common_get_handler (httpd_req_t * req);
 esp_err_t temperature_data_get_handler(httpd_req_t * req);
+esp_err_t light_brightness_get_handler(httpd_req_t * req);
 esp_err_t light_brightness_post_handler(httpd_req_t * req);
-void httpd_register_basic_auth(httpd_handle_t server_handle);
-char * encrypt_auth_credentials(const char * username, const char * password);
+esp_err_t send_json_response(httpd_req_t * req, cJSON * root, const char * uri, uint32_t ttl_ms);
 esp_err_t set_content_type_from_file(httpd_req_t * req, const char * filepath);
+esp_err_t send_chunk_sink(void * p_ctx, const char * data, size_t len);
+esp_err_t webpage_dispatch(httpd_req_t * req);
+esp_err_t webpage_server_start(httpd_handle_t * server_handle);
+webpage_route_t * webpage_route(webpage_obj_t * server_cred, http_uri_handler fp_handler, 
+                                    void * p_user_ctx, route_class_t route_class);
+
+/* Start plain HTTP or, with CONFIG_WEB_HTTPS_ENABLE, HTTPS with an ECDSA P-256
+ * certificate and session tickets so returning clients skip the full handshake */
+esp_err_t webpage_server_start(httpd_handle_t * server_handle)
+{
+    #if CONFIG_WEB_HTTPS_ENABLE
+    extern const unsigned char servercert_start[] asm("_binary_servercert_pem_start");
+    extern const unsigned char servercert_end[]   asm("_binary_servercert_pem_end");
+    extern const unsigned char prvtkey_start[]    asm("_binary_prvtkey_pem_start");
+    extern const unsigned char prvtkey_end[]      asm("_binary_prvtkey_pem_end");
+
+    httpd_ssl_config_t ssl_config = HTTPD_SSL_CONFIG_DEFAULT();
+    httpd_config_t * config = &ssl_config.httpd;
+    ssl_config.servercert = servercert_start;
+    ssl_config.servercert_len = servercert_end - servercert_start;
+    ssl_config.prvtkey_pem = prvtkey_start;
+    ssl_config.prvtkey_len = prvtkey_end - prvtkey_start;
+    #if CONFIG_ESP_TLS_SERVER_SESSION_TICKETS
+    ssl_config.session_tickets = true;
+    #endif
+    #else
+    httpd_config_t default_config = HTTPD_DEFAULT_CONFIG();
+    httpd_config_t * config = &default_config;
+    #endif
+
+    config->uri_match_fn = httpd_uri_match_wildcard;
+    config->max_uri_handlers = WEBPAGE_MAX_ROUTES;
+    // config->lru_purge_enable = true;
+
+    #if CONFIG_WEB_HTTPS_ENABLE
+    return httpd_ssl_start(server_handle, &ssl_config);
+    #else
+    return httpd_start(server_handle, config);
+    #endif
+}
 
 void webpage_init(webpage_obj_t * server_cred)
 {
     esp_err_t err_ret = init_vfs(server_cred);
+    server_cred->light.red = 0;
+    server_cred->light.green = 0;
+    server_cred->light.blue = 0;
+    resp_cache_init(&server_cred->resp_cache);
+    rate_limit_init(&server_cred->rate_limit);
+
+    if ((ESP_OK == err_ret) && (ESP_OK != auth_init(&server_cred->auth)))
+    {
+        /* auth_check rejects every request rather than serving unauthenticated */
+        ESP_LOGE(LOG_TAG, "Error initializing authentication");
+    }
+    server_cred->route_count = 0;
 
     if (ESP_OK == err_ret)
     {
+        asset_update_init(server_cred);
+        /* Index and preload the web files in the background while the server starts */
+        vfs_index_start(webpage_active_root(server_cred), warmup_done_cb, server_cred);
+
+        if (ESP_OK != ota_update_init())
+        {
+            ESP_LOGE(LOG_TAG, "Firmware upload is not available");
+        }
         httpd_handle_t server_handle = NULL;
-        httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-        config.uri_match_fn = httpd_uri_match_wildcard;
-        // config.lru_purge_enable = true;
     
-        if (ESP_OK == httpd_start(&server_handle, &config)) 
+        if (ESP_OK == webpage_server_start(&server_handle)) 
         {
             // Set URI handlers
             /* URI handler for fetching system info */
-            httpd_uri_t system_info_get_uri = webpage_handler("/api/v1/system/info", HTTP_GET,
-                                                                system_info_get_handler, server_cred);
+            httpd_uri_t system_info_get_uri = webpage_handler(URI_SYSTEM_INFO, HTTP_GET, webpage_dispatch,
+                                    webpage_route(server_cred, system_info_get_handler,
+                                                    server_cred, ROUTE_CLASS_API));
             /* URI handler for fetching temperature data */
-            httpd_uri_t temperature_data_get_uri = webpage_handler("/api/v1/temp/raw", HTTP_GET,
-                                                            temperature_data_get_handler, server_cred);
+            httpd_uri_t temperature_data_get_uri = webpage_handler(URI_TEMP_RAW, HTTP_GET, webpage_dispatch,
+                                    webpage_route(server_cred, temperature_data_get_handler,
+                                                    server_cred, ROUTE_CLASS_API));
+            /* URI handler for reading back the light brightness */
+            httpd_uri_t light_brightness_get_uri = webpage_handler(URI_LIGHT, HTTP_GET, webpage_dispatch,
+                                    webpage_route(server_cred, light_brightness_get_handler,
+                                                    server_cred, ROUTE_CLASS_API));
             /* URI handler for light brightness control */
-            httpd_uri_t light_brightness_post_uri = webpage_handler("/api/v1/light/brightness", HTTP_POST,
-                                                                light_brightness_post_handler, server_cred);
+            httpd_uri_t light_brightness_post_uri = webpage_handler(URI_LIGHT, HTTP_POST, webpage_dispatch,
+                                    webpage_route(server_cred, light_brightness_post_handler,
+                                                    server_cred, ROUTE_CLASS_API));
+            /* URI handlers for firmware upload and its progress */
+            httpd_uri_t ota_post_uri = webpage_handler(URI_OTA, HTTP_POST, webpage_dispatch,
+                                    webpage_route(server_cred, ota_update_post_handler,
+                                                    server_cred, ROUTE_CLASS_API));
+            httpd_uri_t ota_get_uri = webpage_handler(URI_OTA, HTTP_GET, webpage_dispatch,
+                                    webpage_route(server_cred, ota_update_get_handler,
+                                                    server_cred, ROUTE_CLASS_API));
+            /* URI handler for the most recent deferred log records */
+            httpd_uri_t logs_get_uri = webpage_handler(URI_LOGS, HTTP_GET, webpage_dispatch,
+                                    webpage_route(server_cred, log_ring_get_handler,
+                                                    server_cred, ROUTE_CLASS_API));
+            /* URI handler for the trace flight recorder */
+            httpd_uri_t trace_get_uri = webpage_handler(URI_TRACE, HTTP_GET, webpage_dispatch,
+                                    webpage_route(server_cred, trace_get_handler,
+                                                    server_cred, ROUTE_CLASS_API));
+            /* URI handlers for staging and switching a new set of web files */
+            httpd_uri_t asset_manifest_uri = webpage_handler(URI_ASSET_MANIFEST, HTTP_POST, webpage_dispatch,
+                                    webpage_route(server_cred, asset_manifest_post_handler,
+                                                    server_cred, ROUTE_CLASS_API));
+            httpd_uri_t asset_file_uri = webpage_handler(URI_ASSET_FILE, HTTP_PUT, webpage_dispatch,
+                                    webpage_route(server_cred, asset_file_put_handler,
+                                                    server_cred, ROUTE_CLASS_API));
+            httpd_uri_t asset_commit_uri = webpage_handler(URI_ASSET_COMMIT, HTTP_POST, webpage_dispatch,
+                                    webpage_route(server_cred, asset_commit_post_handler,
+                                                    server_cred, ROUTE_CLASS_API));
             /* URI handler for getting web server files */
-            httpd_uri_t common_get_uri = webpage_handler("/*", HTTP_GET, rest_common_get_handler, 
-                                                            server_cred);
+            httpd_uri_t common_get_uri = webpage_handler("/*", HTTP_GET, webpage_dispatch,
+                                    webpage_route(server_cred, rest_common_get_handler,
+                                                    server_cred, ROUTE_CLASS_STATIC));
     
             httpd_register_uri_handler(server_handle, &system_info_get_uri);
             httpd_register_uri_handler(server_handle, &temperature_data_get_uri);
+            httpd_register_uri_handler(server_handle, &light_brightness_get_uri);
             httpd_register_uri_handler(server_handle, &light_brightness_post_uri);
+            httpd_register_uri_handler(server_handle, &ota_post_uri);
+            httpd_register_uri_handler(server_handle, &ota_get_uri);
+            httpd_register_uri_handler(server_handle, &logs_get_uri);
+            httpd_register_uri_handler(server_handle, &trace_get_uri);
+            httpd_register_uri_handler(server_handle, &asset_manifest_uri);
+            httpd_register_uri_handler(server_handle, &asset_file_uri);
+            httpd_register_uri_handler(server_handle, &asset_commit_uri);
             httpd_register_uri_handler(server_handle, &common_get_uri);
-            #if ENABLE_AUTH
-            httpd_register_basic_auth(server_handle);
-            #endif
         }
         else
         {
@@ -81,26 +196,142 @@ void webpage_init(webpage_obj_t * server_cred)
     }
 }
 
+/* Tree the static files are served from, switched by asset_commit_post_handler */
+const char * webpage_active_root(webpage_obj_t * server_cred)
+{
+    return __atomic_load_n(&server_cred->web_root, __ATOMIC_ACQUIRE);
+}
+
+/* Keep a route in the server table, it is handed to webpage_dispatch as user context */
+webpage_route_t * webpage_route(webpage_obj_t * server_cred, http_uri_handler fp_handler, 
+                                    void * p_user_ctx, route_class_t route_class)
+{
+    assert(server_cred->route_count < WEBPAGE_MAX_ROUTES);
+    webpage_route_t * route = &server_cred->routes[server_cred->route_count++];
+    route->fp_handler = fp_handler;
+    route->p_user_ctx = p_user_ctx;
+    route->route_class = route_class;
+    route->p_server = server_cred;
+    return route;
+}
+
+/* Common entry point of all routes, requests are checked before the route handler runs */
+esp_err_t webpage_dispatch(httpd_req_t * req)
+{
+    webpage_route_t * route = (webpage_route_t *)req->user_ctx;
+    webpage_obj_t * server_context = (webpage_obj_t *)route->p_server;
+    esp_err_t err_ret = ESP_OK;
+    int rejected = 0;
+
+    TRACE_REQUEST_BEGIN();
+    TRACE_SPAN_BEGIN(span);
+    esp_err_t check_ret = rate_limit_check(&server_context->rate_limit, req, route->route_class);
+
+    if (ESP_OK != check_ret)
+    {
+        /* Already answered with 429/503, keep the connection open */
+        rejected = (ESP_ERR_NO_MEM == check_ret) ? 503 : 429;
+    }
+    else if (ESP_OK != auth_check(&server_context->auth, req))
+    {
+        /* Already answered with 401 */
+        rejected = 401;
+    }
+    else
+    {
+        req->user_ctx = route->p_user_ctx;
+        err_ret = route->fp_handler(req);
+    }
+
+    if (0 != rejected)
+    {
+        TRACE_SPAN_END(span, "http_rejected", rejected);
+    }
+    else
+    {
+        TRACE_SPAN_END(span, "http_request", req->method);
+    }
+    return err_ret;
+}
+
 // Stop the httpd server
 esp_err_t stop_webserver(httpd_handle_t server)
 {
     return httpd_stop(server);
 }
 
+/* Serialize root, keep a copy in the response cache and send it */
+esp_err_t send_json_response(httpd_req_t * req, cJSON * root, const char * uri, uint32_t ttl_ms)
+{
+    webpage_obj_t * server_context = (webpage_obj_t *)req->user_ctx;
+    TRACE_SPAN_BEGIN(span);
+    const char * json = cJSON_PrintUnformatted(root);
+    esp_err_t err_ret = ESP_ERR_NO_MEM;
+    TRACE_SPAN_END(span, "cjson_print", (NULL != json) ? strlen(json) : 0);
+
+    if (json)
+    {
+        size_t len = strlen(json);
+        resp_cache_store(&server_context->resp_cache, uri, "application/json", json, len, ttl_ms);
+        httpd_resp_set_type(req, "application/json");
+        err_ret = httpd_resp_send(req, json, len);
+        free((void *)json);
+    }
+    else
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to serialize response");
+    }
+    cJSON_Delete(root);
+    return err_ret;
+}
+
+/* The warm-up statistics are part of the system info */
+void warmup_done_cb(void * p_ctx)
+{
+    webpage_obj_t * server_context = (webpage_obj_t *)p_ctx;
+    resp_cache_invalidate(&server_context->resp_cache, URI_SYSTEM_INFO);
+}
+
 /* Handler for getting system handler */
 esp_err_t system_info_get_handler(httpd_req_t * req)
 {
-    httpd_resp_set_type(req, "application/json");
+    webpage_obj_t * server_context = (webpage_obj_t *)req->user_ctx;
+
+    if (ESP_ERR_NOT_FOUND != resp_cache_send(&server_context->resp_cache, req, 
+                                    server_context->scratch, sizeof(server_context->scratch)))
+    {
+        return ESP_OK;
+    }
+
     cJSON *root = cJSON_CreateObject();
     esp_chip_info_t chip_info;
     esp_chip_info(&chip_info);
     cJSON_AddStringToObject(root, "version", IDF_VER);
     cJSON_AddNumberToObject(root, "cores", chip_info.cores);
-    const char *sys_info = cJSON_Print(root);
-    httpd_resp_sendstr(req, sys_info);
-    free((void *)sys_info);
-    cJSON_Delete(root);
-    return ESP_OK;
+    vfs_index_stats_t warmup;
+    vfs_index_get_stats(&warmup);
+    cJSON_AddBoolToObject(root, "warmup_done", warmup.done);
+    cJSON_AddNumberToObject(root, "warmup_us", warmup.warmup_us);
+    cJSON_AddNumberToObject(root, "indexed_files", warmup.indexed_files);
+    cJSON_AddNumberToObject(root, "preloaded_files", warmup.preloaded_files);
+    cJSON_AddNumberToObject(root, "preloaded_bytes", warmup.preloaded_bytes);
+    cJSON_AddNumberToObject(root, "rate_limited", server_context->rate_limit.limited);
+    cJSON_AddNumberToObject(root, "shed", server_context->rate_limit.shed);
+    cJSON_AddNumberToObject(root, "log_drops", log_ring_drops());
+    network_supervisor_t supervisor;
+    network_get_supervisor(&supervisor);
+    cJSON_AddNumberToObject(root, "link_flaps", supervisor.link_flaps);
+    cJSON_AddNumberToObject(root, "last_recover_ms", supervisor.last_recover_us / 1000);
+    cJSON_AddNumberToObject(root, "max_recover_ms", supervisor.max_recover_us / 1000);
+    cJSON_AddNumberToObject(root, "bringup_ms", supervisor.bringup_us / 1000);
+    cJSON_AddNumberToObject(root, "bringup_idle_pct", supervisor.bringup_idle_pct);
+    cJSON_AddStringToObject(root, "net_profile", network_profile_name());
+    cJSON_AddNumberToObject(root, "tcp_mss", CONFIG_LWIP_TCP_MSS);
+    cJSON_AddNumberToObject(root, "tcp_wnd", CONFIG_LWIP_TCP_WND_DEFAULT);
+    cJSON_AddNumberToObject(root, "tcp_snd_buf", CONFIG_LWIP_TCP_SND_BUF_DEFAULT);
+    cJSON_AddNumberToObject(root, "free_heap", esp_get_free_heap_size());
+    cJSON_AddNumberToObject(root, "min_free_heap", esp_get_minimum_free_heap_size());
+    return send_json_response(req, root, URI_SYSTEM_INFO, SYSINFO_TTL_MS);
 }
 
 /* Send HTTP response with the contents of the requested file */
@@ -108,8 +339,11 @@ esp_err_t rest_common_get_handler(httpd_req_t * req)
 {
     char filepath[ESP_VFS_PATH_MAX + 128];
     webpage_obj_t * server_context = (webpage_obj_t *)req->user_ctx;
+    /* Resolved once so the whole response comes from one tree */
+    const char * root = webpage_active_root(server_context);
+    size_t root_len = strlen(root);
 
-    strlcpy(filepath, server_context->web_mount_point, sizeof(filepath));
+    strlcpy(filepath, root, sizeof(filepath));
 
     if (req->uri[strlen(req->uri) - 1] == '/') 
     {
@@ -119,64 +353,126 @@ esp_err_t rest_common_get_handler(httpd_req_t * req)
     {
         strlcat(filepath, req->uri, sizeof(filepath));
     }
-    int fd = open(filepath, O_RDONLY, 0);
 
-    if (fd == -1) 
+    /* Pointer file, manifests and release slots belong to the asset updater */
+    if (vfs_index_is_reserved(filepath + root_len))
     {
-        ESP_LOGE(LOG_TAG, "Failed to open file : %s", filepath);
-        /* Respond with 500 Internal Server Error */
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to read existing file");
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File does not exist");
         return ESP_FAIL;
     }
 
-    set_content_type_from_file(req, filepath);
-    char * chunk = server_context->scratch;
-    ssize_t read_bytes;
+    const vfs_index_entry_t * entry = vfs_index_find(filepath + root_len);
 
-    do 
+    if (NULL != entry)
     {
-        /* Read file in chunks into the scratch buffer */
-        read_bytes = read(fd, chunk, sizeof(server_context->scratch));
+        char if_none_match[sizeof(entry->etag)];
 
-        if (read_bytes == -1) 
+        httpd_resp_set_hdr(req, "ETag", entry->etag);
+
+        if ((ESP_OK == httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, 
+                                                    sizeof(if_none_match))) && 
+                (0 == strcmp(if_none_match, entry->etag)))
         {
-            ESP_LOGE(LOG_TAG, "Failed to read file : %s", filepath);
+            httpd_resp_set_status(req, "304 Not Modified");
+            return httpd_resp_send(req, NULL, 0);
         }
-        else if (read_bytes > 0) 
+
+        if (NULL != entry->data)
         {
-            /* Send the buffer contents as HTTP response chunk */
-            if (httpd_resp_send_chunk(req, chunk, read_bytes) != ESP_OK) 
-            {
-                close(fd);
-                ESP_LOGE(LOG_TAG, "File sending failed!");
-                /* Abort sending file */
-                httpd_resp_sendstr_chunk(req, NULL);
-                /* Respond with 500 Internal Server Error */
-                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to send file");
-                return ESP_FAIL;
-            }
+            /* Preloaded at boot, no storage access */
+            set_content_type_from_file(req, filepath);
+            return httpd_resp_send(req, entry->data, entry->size);
         }
-    } while (read_bytes > 0);
+    }
+
+    TRACE_SPAN_BEGIN(open_span);
+    int fd = open(filepath, O_RDONLY, 0);
+    const char * prev_root = __atomic_load_n(&server_context->prev_web_root, __ATOMIC_ACQUIRE);
+
+    if ((fd == -1) && (NULL != prev_root))
+    {
+        /* Pages loaded before a switch may still ask for files the new release dropped */
+        char prev_filepath[ESP_VFS_PATH_MAX + 128];
+
+        snprintf(prev_filepath, sizeof(prev_filepath), "%s%s", prev_root, filepath + root_len);
+        fd = open(prev_filepath, O_RDONLY, 0);
+    }
+    TRACE_SPAN_END(open_span, "vfs_open", fd);
+
+    if (fd == -1) 
+    {
+        LOG_RING_STR_E(LOG_TAG, "Failed to open file : %s", req->uri);
+        /* Respond with 500 Internal Server Error */
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to read existing file");
+        return ESP_FAIL;
+    }
+
+    set_content_type_from_file(req, filepath);
+    vfs_stream_stats_t stats = {0};
+
+    /* The storage reader fills the next buffers while this task sends the current one */
+    if (ESP_OK != vfs_stream_file(fd, send_chunk_sink, req, &stats))
+    {
+        close(fd);
+        LOG_RING_E(LOG_TAG, "File sending failed!");
+        /* Abort sending file */
+        httpd_resp_sendstr_chunk(req, NULL);
+        /* Respond with 500 Internal Server Error */
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to send file");
+        return ESP_FAIL;
+    }
 
     /* Close file after sending complete */
     close(fd);
-    ESP_LOGI(LOG_TAG, "File sending complete");
+    LOG_RING_STR_I(LOG_TAG, "File sending complete: %s, %lu bytes in %lu us (%lu KB/s)", req->uri, 
+                    (uint32_t)stats.bytes, (uint32_t)stats.elapsed_us, 
+                    (uint32_t)((stats.elapsed_us > 0) ? (stats.bytes * 1000LL) / stats.elapsed_us : 0));
     /* Respond with an empty chunk to signal HTTP response completion */
     httpd_resp_send_chunk(req, NULL, 0);
     return ESP_OK;
 }
 
+/* Forward a block read by the storage stream to the client */
+esp_err_t send_chunk_sink(void * p_ctx, const char * data, size_t len)
+{
+    TRACE_SPAN_BEGIN(span);
+    esp_err_t err_ret = httpd_resp_send_chunk((httpd_req_t *)p_ctx, data, len);
+    TRACE_SPAN_END(span, "resp_send_chunk", len);
+    return err_ret;
+}
+
 /* Handler for getting temperature data */
 esp_err_t temperature_data_get_handler(httpd_req_t * req)
 {
-    httpd_resp_set_type(req, "application/json");
+    webpage_obj_t * server_context = (webpage_obj_t *)req->user_ctx;
+
+    if (ESP_ERR_NOT_FOUND != resp_cache_send(&server_context->resp_cache, req, 
+                                    server_context->scratch, sizeof(server_context->scratch)))
+    {
+        return ESP_OK;
+    }
+
     cJSON *root = cJSON_CreateObject();
     cJSON_AddNumberToObject(root, "raw", esp_random() % 20);
-    const char *sys_info = cJSON_Print(root);
-    httpd_resp_sendstr(req, sys_info);
-    free((void *)sys_info);
-    cJSON_Delete(root);
-    return ESP_OK;
+    return send_json_response(req, root, URI_TEMP_RAW, TEMP_TTL_MS);
+}
+
+/* Handler for reading back the last light control value */
+esp_err_t light_brightness_get_handler(httpd_req_t * req)
+{
+    webpage_obj_t * server_context = (webpage_obj_t *)req->user_ctx;
+
+    if (ESP_ERR_NOT_FOUND != resp_cache_send(&server_context->resp_cache, req, 
+                                    server_context->scratch, sizeof(server_context->scratch)))
+    {
+        return ESP_OK;
+    }
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "red", server_context->light.red);
+    cJSON_AddNumberToObject(root, "green", server_context->light.green);
+    cJSON_AddNumberToObject(root, "blue", server_context->light.blue);
+    return send_json_response(req, root, URI_LIGHT, LIGHT_TTL_MS);
 }
 
 /* Simple handler for light brightness control */
@@ -214,8 +510,13 @@ esp_err_t light_brightness_post_handler(httpd_req_t * req)
     int red = cJSON_GetObjectItem(root, "red")->valueint;
     int green = cJSON_GetObjectItem(root, "green")->valueint;
     int blue = cJSON_GetObjectItem(root, "blue")->valueint;
-    ESP_LOGI(LOG_TAG, "Light control: red = %d, green = %d, blue = %d", red, green, blue);
+    LOG_RING_I(LOG_TAG, "Light control: red = %d, green = %d, blue = %d", red, green, blue);
     cJSON_Delete(root);
+    server_context->light.red = red;
+    server_context->light.green = green;
+    server_context->light.blue = blue;
+    /* The cached read-back of the light state is stale now */
+    resp_cache_invalidate(&server_context->resp_cache, URI_LIGHT);
     httpd_resp_sendstr(req, "Post control value successfully");
     return ESP_OK;
 }
@@ -253,155 +554,6 @@ esp_err_t set_content_type_from_file(httpd_req_t *req, const char *filepath)
     return httpd_resp_set_type(req, type);
 }
 
-#if ENABLE_AUTH
-void httpd_register_basic_auth(httpd_handle_t server_handle)
-{
-    basic_auth_info_t * basic_auth_info = calloc(1, sizeof(basic_auth_info_t));
-
-    if (basic_auth_info) 
-    {
-        basic_auth_info->username = "chhabi9585";
-        basic_auth_info->password = "Adhikari9585@";
-        httpd_uri_t basic_auth = webpage_handler("/", HTTP_GET, basic_auth_get_handler, 
-                                                    basic_auth_info);
-        httpd_register_uri_handler(server_handle, &basic_auth);
-    }
-
-    else
-    {
-        ESP_LOGE(LOG_TAG, "Error in registering authorization");
-    }
-}
-
-/* An HTTP GET handler */
-esp_err_t basic_auth_get_handler(httpd_req_t * req)
-{
-    char * buf = NULL;
-    size_t buf_len = 0;
-    basic_auth_info_t * basic_auth_info = req->user_ctx;
-
-    buf_len = httpd_req_get_hdr_value_len(req, "Authorization") + 1;
-    if (buf_len > 1) 
-    {
-        buf = calloc(1, buf_len);
-
-        if (!buf) 
-        {
-            ESP_LOGE(LOG_TAG, "No enough memory for basic authorization");
-            return ESP_ERR_NO_MEM;
-        }
-
-        if (httpd_req_get_hdr_value_str(req, "Authorization", buf, buf_len) == ESP_OK) 
-        {
-            ESP_LOGI(LOG_TAG, "Found header => Authorization: %s", buf);
-        }
-        else 
-        {
-            ESP_LOGE(LOG_TAG, "No auth value received");
-        }
-
-        char * auth_credentials = encrypt_auth_credentials(basic_auth_info->username, 
-                                                            basic_auth_info->password);
-        
-        if (!auth_credentials) 
-        {
-            ESP_LOGE(LOG_TAG, "No enough memory for basic authorization credentials");
-            free(buf);
-            return ESP_ERR_NO_MEM;
-        }
-
-        if (strncmp(auth_credentials, buf, buf_len)) 
-        {
-            ESP_LOGE(LOG_TAG, "Not authenticated");
-            httpd_resp_set_status(req, "401 UNAUTHORIZED");
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_set_hdr(req, "Connection", "keep-alive");
-            httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"Hello\"");
-            httpd_resp_send(req, NULL, 0);
-        }
-        else 
-        {
-            ESP_LOGI(LOG_TAG, "Authenticated!");
-            char *basic_auth_resp = NULL;
-            httpd_resp_set_status(req, HTTPD_200);
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_set_hdr(req, "Connection", "keep-alive");
-            int rc = asprintf(&basic_auth_resp, "{\"authenticated\": true,\"user\": \"%s\"}", 
-                                                    basic_auth_info->username);
-            
-            if (rc < 0) 
-            {
-                ESP_LOGE(LOG_TAG, "asprintf() returned: %d", rc);
-                free(auth_credentials);
-                return ESP_FAIL;
-            }
-
-            if (!basic_auth_resp) 
-            {
-                ESP_LOGE(LOG_TAG, "No enough memory for basic authorization response");
-                free(auth_credentials);
-                free(buf);
-                return ESP_ERR_NO_MEM;
-            }
-            httpd_resp_send(req, basic_auth_resp, strlen(basic_auth_resp));
-            free(basic_auth_resp);
-        }
-        free(auth_credentials);
-        free(buf);
-    }
-    else 
-    {
-        ESP_LOGE(LOG_TAG, "No auth header received");
-        httpd_resp_set_status(req, "401 UNAUTHORIZED");
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_set_hdr(req, "Connection", "keep-alive");
-        httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"Hello\"");
-        httpd_resp_send(req, NULL, 0);
-    }
-
-    return ESP_OK;
-}
-
-char * encrypt_auth_credentials (const char * username, const char * password)
-{
-    size_t out;
-    char * user_info = NULL;
-    char * digest = NULL;
-    size_t n = 0;
-    int rc = asprintf(&user_info, "%s:%s", username, password);
-
-    if (rc < 0) 
-    {
-        ESP_LOGE(LOG_TAG, "asprintf() returned: %d", rc);
-        return NULL;
-    }
-
-    if (!user_info) 
-    {
-        ESP_LOGE(LOG_TAG, "No enough memory for user information");
-        return NULL;
-    }
-
-    esp_crypto_base64_encode(NULL, 0, &n, (const unsigned char *)user_info, strlen(user_info));
-
-    /* 6: The length of the "Basic " string
-     * n: Number of bytes for a base64 encode format
-     * 1: Number of bytes for a reserved which be used to fill zero
-    */
-    digest = calloc(1, 6 + n + 1);
-
-    if (digest) 
-    {
-        strcpy(digest, "Basic ");
-        esp_crypto_base64_encode((unsigned char *)digest + 6, n, &out, 
-                                    (const unsigned char *)user_info, strlen(user_info));
-    }
-
-    free(user_info);
-    return digest;
-}
-#endif
-
 inline httpd_uri_t webpage_handler (const char * p_uri, httpd_method_t e_method, 
                                         http_uri_handler fp_handler, void * p_user_ctx)
 {
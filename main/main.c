@@ -3,6 +3,8 @@
 #include "esp_log.h"
 #include "webpage.h"
 #include "network.h"
+#include "log_ring.h"
+#include "trace.h"
 
 // Status LED 
 #define LED_RED GPIO_NUM_13
@@ -12,23 +14,25 @@ void led_config(void);
 void led_task(void * pvParameter);
 
 // Variables
+/* Referenced by the network event handlers for the lifetime of the application */
+static ethernet_obj_t s_eth_obj;
 
 // Main application
 void app_main() 
 {
     webpage_obj_t * server_cred;
-    ethernet_obj_t * eth_obj;
-    eth_obj = pvPortMalloc(sizeof(ethernet_obj_t));
     server_cred = pvPortMalloc(sizeof(webpage_obj_t));
+    log_ring_init();
+    trace_init();
     led_config();
 
+    strlcpy(s_eth_obj.mdns_cred.mdns_host_name, "esp_web_server", 15);
+    strlcpy(s_eth_obj.mdns_cred.mdns_instance_name, "esp_web_server", 15);
+    ethernet_init(&s_eth_obj);
     // The LED task is used to show the connection status
-    xTaskCreate(&led_task, "led_task", 2048, eth_obj, 5, NULL);
-    strlcpy(eth_obj->mdns_cred.mdns_host_name, "esp_web_server", 15);
-    strlcpy(eth_obj->mdns_cred.mdns_instance_name, "esp_web_server", 15);
-    ethernet_init(eth_obj);
+    xTaskCreate(&led_task, "led_task", 2048, NULL, 5, NULL);
 
-    do {} while(true != eth_obj->ethernet_status_flag);
+    network_wait(NETWORK_CONNECTED_BIT, portMAX_DELAY);
     strlcpy(server_cred->web_mount_point, "/dist", 6); 
     webpage_init(server_cred);
 }
@@ -41,31 +45,21 @@ void led_config (void)
 
 void led_task(void * pvParameter)
 {
-    bool conn_status = false;
-    ethernet_obj_t * eth_obj = (ethernet_obj_t *)pvParameter;
-
     while (1) 
     {
-        if (true == conn_status)
+        if (0 != network_wait(NETWORK_CONNECTED_BIT, 0))
         {
-            // We are connected - LED on
+            // We are connected - LED on until the connection is lost
             gpio_set_level(LED_RED, 1);
-            vTaskDelay(3000);
-
-            if (NULL != eth_obj)
-            {
-                vPortFree(eth_obj);
-                eth_obj = NULL;
-            }
+            network_wait(NETWORK_DISCONNECTED_BIT, portMAX_DELAY);
         } 
         else 
         {
-            conn_status = eth_obj->ethernet_status_flag;
-            // We are connecting - blink fast
+            // We are connecting - blink fast, the wait ends early on connect
             gpio_set_level(LED_RED, 0);
-            vTaskDelay(200);
+            network_wait(NETWORK_CONNECTED_BIT, pdMS_TO_TICKS(200));
             gpio_set_level(LED_RED, 1);
-            vTaskDelay(200);
+            network_wait(NETWORK_CONNECTED_BIT, pdMS_TO_TICKS(200));
         }
     }
 }
@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+"""Measure full vs resumed TLS handshakes against the HTTPS server.
+
+Usage: python tools/https_bench.py [host] [port] [count]
+Defaults match the QEMU port forward: hostfwd=tcp:127.0.0.1:8443-:443
+"""
+import socket
+import ssl
+import sys
+import time
+
+
+def handshake(ctx, host, port, session=None):
+    sock = socket.create_connection((host, port), timeout=30)
+    start = time.perf_counter()
+    tls = ctx.wrap_socket(sock, server_hostname=host, session=session)
+    elapsed = time.perf_counter() - start
+    # Tickets are delivered after the handshake, complete one request before keeping the session
+    tls.sendall(b"GET /api/v1/system/info HTTP/1.1\r\nHost: " + host.encode() + b"\r\nConnection: close\r\n\r\n")
+    while tls.recv(4096):
+        pass
+    reused = tls.session_reused
+    new_session = tls.session
+    tls.close()
+    return elapsed, reused, new_session
+
+
+def report(name, samples):
+    samples.sort()
+    total = sum(samples)
+    print("%-8s n=%d  min %.1f ms  median %.1f ms  max %.1f ms  %.2f handshakes/s" % (
+        name, len(samples), samples[0] * 1000, samples[len(samples) // 2] * 1000,
+        samples[-1] * 1000, len(samples) / total))
+
+
+def main():
+    host = sys.argv[1] if len(sys.argv) > 1 else "127.0.0.1"
+    port = int(sys.argv[2]) if len(sys.argv) > 2 else 8443
+    count = int(sys.argv[3]) if len(sys.argv) > 3 else 10
+
+    ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    ctx.check_hostname = False
+    ctx.verify_mode = ssl.CERT_NONE
+    # The server side speaks TLS 1.2, keep the client there so tickets behave the same everywhere
+    ctx.maximum_version = ssl.TLSVersion.TLSv1_2
+
+    full = [handshake(ctx, host, port)[0] for _ in range(count)]
+
+    _, _, session = handshake(ctx, host, port)
+    resumed = []
+    misses = 0
+    for _ in range(count):
+        elapsed, reused, session = handshake(ctx, host, port, session)
+        resumed.append(elapsed)
+        misses += 0 if reused else 1
+
+    report("full", full)
+    report("resumed", resumed)
+    if misses:
+        print("warning: %d of %d resumptions fell back to a full handshake" % (misses, count))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""Boot the firmware in QEMU with link flap injection and check the recovery.
+
+Usage: python tools/link_flap_check.py [flash_image] [sd_image] [flaps] [max_recover_ms]
+Build with sdkconfig.link_flap so a flap is injected every 5 s, merge the flash
+image as result.bin and create sd_image.bin as described in the Readme.
+Pass "-" as flash_image to check a device that is already running on 127.0.0.1:8000.
+Exits with 1 if fewer flaps were seen or a recovery took longer than max_recover_ms.
+"""
+import json
+import subprocess
+import sys
+import time
+import urllib.request
+
+BASE = "http://127.0.0.1:8000"
+
+
+def system_info():
+    with urllib.request.urlopen(BASE + "/api/v1/system/info", timeout=5) as resp:
+        return json.loads(resp.read())
+
+
+def boot(flash_image, sd_image):
+    return subprocess.Popen(["qemu-system-xtensa", "-nographic", "-machine", "esp32",
+                             "-drive", "file=%s,if=mtd,format=raw" % flash_image,
+                             "-nic", "user,model=open_eth,id=lo0,hostfwd=tcp:127.0.0.1:8000-:80",
+                             "-drive", "file=%s,if=sd,format=raw" % sd_image],
+                            stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL)
+
+
+def wait_for(flaps, timeout):
+    info = {}
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            info = system_info()
+            if info.get("link_flaps", 0) >= flaps:
+                break
+        except OSError:
+            # Down while booting or during a flap
+            pass
+        time.sleep(1)
+    return info
+
+
+def main():
+    flash_image = sys.argv[1] if len(sys.argv) > 1 else "result.bin"
+    sd_image = sys.argv[2] if len(sys.argv) > 2 else "sd_image.bin"
+    flaps = int(sys.argv[3]) if len(sys.argv) > 3 else 3
+    max_recover_ms = int(sys.argv[4]) if len(sys.argv) > 4 else 1000
+
+    qemu = boot(flash_image, sd_image) if "-" != flash_image else None
+    try:
+        # Boot takes a while in QEMU, then one flap every 5 s with sdkconfig.link_flap
+        info = wait_for(flaps, 60 + flaps * 10)
+    finally:
+        if qemu is not None:
+            qemu.terminate()
+            qemu.wait()
+
+    print("link_flaps %s  last_recover_ms %s  max_recover_ms %s" % (
+        info.get("link_flaps"), info.get("last_recover_ms"), info.get("max_recover_ms")))
+    if info.get("link_flaps", 0) < flaps:
+        print("FAIL: expected at least %d link flaps" % flaps)
+        return 1
+    if info.get("max_recover_ms", max_recover_ms + 1) > max_recover_ms:
+        print("FAIL: recovery took longer than %d ms" % max_recover_ms)
+        return 1
+    print("PASS")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
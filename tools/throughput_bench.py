@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+"""Download the web bundle repeatedly and report throughput and heap cost.
+
+Usage: python tools/throughput_bench.py [base_url] [rounds]
+Defaults match the QEMU port forward: hostfwd=tcp:127.0.0.1:8000-:80
+Run once per network profile build and compare the output lines.
+"""
+import json
+import re
+import sys
+import time
+import urllib.request
+
+
+def fetch(url):
+    with urllib.request.urlopen(url, timeout=60) as resp:
+        return resp.read()
+
+
+def system_info(base):
+    return json.loads(fetch(base + "/api/v1/system/info"))
+
+
+def main():
+    base = (sys.argv[1] if len(sys.argv) > 1 else "http://127.0.0.1:8000").rstrip("/")
+    rounds = int(sys.argv[2]) if len(sys.argv) > 2 else 5
+
+    index = fetch(base + "/")
+    assets = sorted(set(re.findall(rb'(?:src|href)="(/[^"]+)"', index)))
+    urls = [base + "/"] + [base + a.decode() for a in assets]
+
+    before = system_info(base)
+    total = 0
+    start = time.perf_counter()
+    for _ in range(rounds):
+        for url in urls:
+            total += len(fetch(url))
+    elapsed = time.perf_counter() - start
+    # Let the response cache expire so the numbers are fresh
+    time.sleep(3)
+    after = system_info(base)
+
+    print("profile %s  tcp_wnd %s  tcp_snd_buf %s  files %d  rounds %d" % (
+        after.get("net_profile"), after.get("tcp_wnd"), after.get("tcp_snd_buf"), len(urls), rounds))
+    print("%d bytes in %.2f s: %.3f MB/s" % (total, elapsed, total / elapsed / 1e6))
+    print("free heap %s -> %s, minimum free heap %s" % (
+        before.get("free_heap"), after.get("free_heap"), after.get("min_free_heap")))
+
+
+if __name__ == "__main__":
+    main()